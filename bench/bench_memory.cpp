@@ -0,0 +1,115 @@
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "util/rng.h"
+#include "spicomp_setting.h"
+#include "spicomp_simulator.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   Counting Allocations
+// -------------------------------------------------------------------------------------------
+
+// Every object that is copied onto the heap goes through the global operator new, so the bytes
+// allocated in a step bound the bytes copied in that step from above. The plan arenas allocate
+// through it too (see ContingencyFormationPlan), so a freshly computed plan is counted as well.
+
+namespace {
+std::atomic<std::size_t> allocated_byte_num{0};
+std::atomic<std::size_t> allocation_num{0};
+
+void* allocate(std::size_t size, std::size_t alignment) {
+  allocated_byte_num.fetch_add(size, std::memory_order_relaxed);
+  allocation_num.fetch_add(1, std::memory_order_relaxed);
+  if (size == 0) size = 1;
+  void* p = (alignment <= alignof(std::max_align_t)) ? std::malloc(size) : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+}
+
+void* operator new(std::size_t size) { return allocate(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size) { return allocate(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, static_cast<std::size_t>(alignment)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+
+// -------------------------------------------------------------------------------------------
+//   The Memory Benchmark
+// -------------------------------------------------------------------------------------------
+
+// Runs the simulator without the GUI and reports the heap bytes and the number of allocations per
+// step, and the size of the contingency formation plan, which the simulator copied in each replan
+// before the plans were moved between the components.
+//
+// Usage: bench_memory [step_num=1000] [seed_num=6]
+
+struct MemoryResult {
+  std::size_t byte_num = 0;
+  std::size_t allocation_num = 0;
+  std::size_t max_step_byte_num = 0;
+  std::size_t plan_byte_num = 0;   // the sum of the plan sizes over the steps
+};
+
+
+MemoryResult runSimulator(const SpicompSetting& setting, int step_num, std::mt19937::result_type seed) {
+  SharedRand::getRng().seed(seed);
+
+  SpicompSimulator simulator(setting);
+  simulator.reset();
+
+  MemoryResult result;
+  for(int step = 0; step < step_num; step++) {
+    [[maybe_unused]] auto& micro_formation = simulator.getCurrentMicroFormation();   // as the GUI does in each tick
+    auto byte_num = allocated_byte_num.load();
+    auto count = allocation_num.load();
+    simulator.nextStep();
+    auto step_byte_num = allocated_byte_num.load() - byte_num;
+    result.byte_num += step_byte_num;
+    result.allocation_num += allocation_num.load() - count;
+    result.max_step_byte_num = std::max(result.max_step_byte_num, step_byte_num);
+    result.plan_byte_num += simulator.getContingencyFormationPlan().getMemorySize();
+  }
+  return result;
+}
+
+
+int main(int argc, char** argv) {
+  int step_num = (argc > 1) ? std::atoi(argv[1]) : 1000;
+  int seed_num = (argc > 2) ? std::atoi(argv[2]) : 6;
+
+  SpicompSetting setting;
+  setting.init(YAML::Load("{RandSeed: 1, IsShowRandSeed: false, WindowSizeX: 1000, WindowSizeY: 1000, "
+                          "SceneSizeX: 500, SceneSizeY: 500, SceneSizeZ: 500}"));   // as in testcase/config_001.yml
+  SharedRand::init(setting.getRandSeed(), setting.isShowRandSeed());
+
+  MemoryResult total;
+  for(int seed = 1; seed <= seed_num; seed++) {
+    auto result = runSimulator(setting, step_num, seed);
+    total.byte_num += result.byte_num;
+    total.allocation_num += result.allocation_num;
+    total.max_step_byte_num = std::max(total.max_step_byte_num, result.max_step_byte_num);
+    total.plan_byte_num += result.plan_byte_num;
+  }
+
+  double total_step_num = static_cast<double>(step_num) * seed_num;
+  std::cout << "steps=" << step_num << " seeds=1.." << seed_num << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "heap KB per step:        " << total.byte_num / total_step_num / 1024.0 << std::endl;
+  std::cout << "max heap KB in a step:   " << total.max_step_byte_num / 1024.0 << std::endl;
+  std::cout << "allocations per step:    " << total.allocation_num / total_step_num << std::endl;
+  std::cout << "plan KB (mean):          " << total.plan_byte_num / total_step_num / 1024.0 << std::endl;
+  return 0;
+}
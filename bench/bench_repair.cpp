@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "util/rng.h"
+#include "spicomp_setting.h"
+#include "spicomp_simulator.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   The Drone Failure Benchmark
+// -------------------------------------------------------------------------------------------
+
+// Runs the simulator without the GUI with thousands of drones and fails a lit drone every few
+// steps, and reports the mean and the maximum time of disableDrone(), which repairs the whole
+// contingency formation plan and must finish within a micro frame (the time step of the simulator).
+//
+// Usage: bench_repair [failure_num=20] [seed_num=3]
+
+struct RepairResult {
+  std::vector<double> milliseconds;
+  int unrepaired_count = 0;
+};
+
+
+RepairResult runFailures(const SpicompSetting& setting, int drone_num, int failure_num, std::mt19937::result_type seed) {
+  SharedRand::getRng().seed(seed);
+
+  SpicompSimulator simulator(setting);
+  simulator.setDroneNum(drone_num);
+  simulator.reset();
+
+  RepairResult result;
+  auto& rng = SharedRand::getRng();
+  for(int failure = 0; failure < failure_num; failure++) {
+    for(int step = 0; step < 7; step++) simulator.nextStep();   // a different micro frame each time
+
+    auto& assignment = simulator.getCurrentFormationPlan().getAssignment2();
+    std::vector<int> lit_drone_ids;
+    for(auto drone_id : assignment) {
+      if (drone_id >= 0) lit_drone_ids.push_back(drone_id);
+    }
+    if (lit_drone_ids.empty()) continue;
+    int drone_id = lit_drone_ids[std::uniform_int_distribution<int>(0, static_cast<int>(lit_drone_ids.size()) - 1)(rng)];
+
+    auto start_time = std::chrono::steady_clock::now();
+    bool is_repaired = simulator.disableDrone(drone_id);
+    auto end_time = std::chrono::steady_clock::now();
+    result.milliseconds.push_back(std::chrono::duration<double, std::milli>(end_time - start_time).count());
+    if (!is_repaired) result.unrepaired_count++;
+  }
+  return result;
+}
+
+
+int main(int argc, char** argv) {
+  int failure_num = (argc > 1) ? std::atoi(argv[1]) : 20;
+  int seed_num = (argc > 2) ? std::atoi(argv[2]) : 3;
+
+  SpicompSetting setting;
+  setting.init(YAML::Load("{RandSeed: 1, IsShowRandSeed: false, WindowSizeX: 1000, WindowSizeY: 1000, "
+                          "SceneSizeX: 500, SceneSizeY: 500, SceneSizeZ: 500}"));   // as in testcase/config_001.yml
+  SharedRand::init(setting.getRandSeed(), setting.isShowRandSeed());
+
+  SpicompSimulator simulator(setting);
+  const double time_step_ms = simulator.getTimeStepDuration() * 1000.0;
+
+  std::cout << "failures=" << failure_num << " seeds=1.." << seed_num << " time step=" << time_step_ms << "ms" << std::endl;
+  std::cout << std::left << std::setw(12) << "drones" << std::right
+            << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::setw(12) << "over step" << std::setw(12) << "unrepaired" << std::endl;
+  std::cout << std::fixed << std::setprecision(3);
+  for(int drone_num : { 1000, 2000, 5000 }) {
+    RepairResult total;
+    for(int seed = 1; seed <= seed_num; seed++) {
+      auto result = runFailures(setting, drone_num, failure_num, seed);
+      total.milliseconds.insert(total.milliseconds.end(), result.milliseconds.begin(), result.milliseconds.end());
+      total.unrepaired_count += result.unrepaired_count;
+    }
+    double sum = 0.0;
+    double max = 0.0;
+    int over_count = 0;
+    for(auto ms : total.milliseconds) {
+      sum += ms;
+      max = std::max(max, ms);
+      if (ms > time_step_ms) over_count++;
+    }
+    std::cout << std::left << std::setw(12) << drone_num << std::right
+              << std::setw(12) << (total.milliseconds.empty() ? 0.0 : sum / static_cast<double>(total.milliseconds.size()))
+              << std::setw(12) << max << std::setw(12) << over_count << std::setw(12) << total.unrepaired_count << std::endl;
+  }
+
+  return 0;
+}
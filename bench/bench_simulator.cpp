@@ -0,0 +1,104 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "util/rng.h"
+#include "spicomp_setting.h"
+#include "spicomp_simulator.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   The Simulator Benchmark
+// -------------------------------------------------------------------------------------------
+
+// Runs the simulator without the GUI for a number of steps and seeds, with and without the formation
+// plan cache and the staging targets, and reports the mean and the maximum distance per frame of the
+// flights of the hidden drones to their new pixels (see HopStatistics), the hit rate of the formation
+// plan cache, and the time per step.
+//
+// Usage: bench_simulator [step_num=1000] [seed_num=6]
+//
+// The gun trajectory is perturbed by std::random_device when the program starts, so the numbers
+// vary a little between runs even with the same seeds.
+
+struct BenchConfig {
+  std::string name;
+  int formation_plan_cache_capacity;
+  bool is_staging_enabled;
+};
+
+
+struct BenchResult {
+  HopStatistics hop_statistics;
+  int cache_hit_count = 0;
+  int cache_miss_count = 0;
+  double seconds = 0.0;
+};
+
+
+BenchResult runSimulator(const SpicompSetting& setting, const BenchConfig& config, int step_num, std::mt19937::result_type seed) {
+  SharedRand::getRng().seed(seed);
+
+  SpicompSimulator simulator(setting);
+  simulator.setFormationPlanCacheCapacity(config.formation_plan_cache_capacity);
+  simulator.setStagingEnabled(config.is_staging_enabled);
+
+  auto start_time = std::chrono::steady_clock::now();
+  simulator.reset();
+  for(int step = 0; step < step_num; step++) {
+    [[maybe_unused]] auto& micro_formation = simulator.getCurrentMicroFormation();   // as the GUI does in each tick
+    simulator.nextStep();
+  }
+  auto end_time = std::chrono::steady_clock::now();
+
+  BenchResult result;
+  result.hop_statistics = simulator.getHopStatistics();
+  result.cache_hit_count = simulator.getFormationPlanCache().getHitCount();
+  result.cache_miss_count = simulator.getFormationPlanCache().getMissCount();
+  result.seconds = std::chrono::duration<double>(end_time - start_time).count();
+  return result;
+}
+
+
+int main(int argc, char** argv) {
+  int step_num = (argc > 1) ? std::atoi(argv[1]) : 1000;
+  int seed_num = (argc > 2) ? std::atoi(argv[2]) : 6;
+
+  SpicompSetting setting;
+  setting.init(YAML::Load("{RandSeed: 1, IsShowRandSeed: false, WindowSizeX: 1000, WindowSizeY: 1000, "
+                          "SceneSizeX: 500, SceneSizeY: 500, SceneSizeZ: 500}"));   // as in testcase/config_001.yml
+  SharedRand::init(setting.getRandSeed(), setting.isShowRandSeed());
+
+  std::vector<BenchConfig> configs = {
+      { "cache on",  FORMATION_PLAN_CACHE_CAPACITY, true },
+      { "cache off", 0, true },
+      { "no staging, cache on",  FORMATION_PLAN_CACHE_CAPACITY, false },
+      { "no staging, cache off", 0, false },
+  };
+
+  std::cout << "steps=" << step_num << " seeds=1.." << seed_num << std::endl;
+  std::cout << std::left << std::setw(24) << "config" << std::right
+            << std::setw(12) << "mean hop" << std::setw(12) << "max hop" << std::setw(12) << "hit rate" << std::setw(12) << "ms/step" << std::endl;
+  std::cout << std::fixed << std::setprecision(2);
+  for(auto& config : configs) {
+    BenchResult total;
+    for(int seed = 1; seed <= seed_num; seed++) {
+      auto result = runSimulator(setting, config, step_num, seed);
+      total.hop_statistics += result.hop_statistics;
+      total.cache_hit_count += result.cache_hit_count;
+      total.cache_miss_count += result.cache_miss_count;
+      total.seconds += result.seconds;
+    }
+    int lookup_num = total.cache_hit_count + total.cache_miss_count;
+    std::cout << std::left << std::setw(24) << config.name << std::right
+              << std::setw(12) << total.hop_statistics.getMeanDistancePerFrame()
+              << std::setw(12) << total.hop_statistics.max_distance_per_frame
+              << std::setw(12) << ((lookup_num > 0) ? static_cast<double>(total.cache_hit_count) / lookup_num : 0.0)
+              << std::setw(12) << total.seconds * 1000.0 / (static_cast<double>(step_num) * seed_num) << std::endl;
+  }
+
+  return 0;
+}
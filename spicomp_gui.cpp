@@ -140,7 +140,7 @@ bool SpicompGui::run_one_step() {
 
   // Draw on the ImGui window
 
-  draw_micro_frame(simulator.getCurrentMicroFrame());
+  draw_micro_formation(simulator.getCurrentMicroFormation());
   // draw_time_step();
   draw_controller();
 
@@ -211,7 +211,7 @@ void SpicompGui::draw_centered_string(int cx, int cy, const std::string& text, i
 }
 
 
-void SpicompGui::draw_micro_frame(const Frame& frame) const {
+void SpicompGui::draw_micro_formation(const Formation& formation) const {
   std::vector<DroneDrawData> drone_draw_data_list;
 
   double cos_delta_x = std::cos(delta_x);
@@ -219,13 +219,16 @@ void SpicompGui::draw_micro_frame(const Frame& frame) const {
   double cos_delta_y = std::cos(delta_y);
   double sin_delta_y = std::sin(delta_y);
 
-  for(auto& pixel : frame.getPixels()) {
+  for(int drone_id = 0; drone_id < formation.size(); drone_id++) {
+    auto& drone_state = formation.getDroneState(drone_id);
+    auto pos = drone_state.getPos();
+    auto color = drone_state.getColor();
 
     // swap the y-axis and z-axis and invert the z-axis
 
-    double rx = pixel.x;
-    double ry = -pixel.z;
-    double rz = pixel.y;
+    double rx = pos.x;
+    double ry = -pos.z;
+    double rz = pos.y;
 
     double screen_x = rx * length_scale;
     double screen_y = ry * length_scale;
@@ -246,7 +249,7 @@ void SpicompGui::draw_micro_frame(const Frame& frame) const {
 
     double scaled_radius = (drone_radius * length_scale) * std::exp(screen_z / z_view_len_scale);
 
-    drone_draw_data_list.emplace_back(screen_x, screen_y, screen_z, scaled_radius, pixel.red, pixel.green, pixel.blue);
+    drone_draw_data_list.emplace_back(screen_x, screen_y, screen_z, scaled_radius, color.red, color.green, color.blue);
   }
 
   // sort by z axis
@@ -117,7 +117,7 @@ private:
 
   void draw_time_step();
 
-  void draw_micro_frame(const Frame& frame) const;
+  void draw_micro_formation(const Formation& formation) const;
 
   void draw_pixel(const DroneDrawData& drone_draw_data) const;
 
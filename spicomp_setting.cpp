@@ -6,9 +6,12 @@ void SpicompSetting::init(const std::string& setting_filename) {
 
   SpicompSetting::setting_filename = setting_filename;
 
-  YAML::Node config = YAML::LoadFile(DEFAULT_SETTING_DIRECTORY + setting_filename);
+  init(YAML::LoadFile(DEFAULT_SETTING_DIRECTORY + setting_filename));
+}
 
 
+void SpicompSetting::init(const YAML::Node& config) {
+
   if (config["RandSeed"]) {
     rand_seed = config["RandSeed"].as<std::random_device::result_type>();
   } else {
@@ -55,7 +55,9 @@ class SpicompSetting {
 
 public:
 
-  void init(const std::string& setting_filename);
+  void init(const std::string& setting_filename);   // load the file in DEFAULT_SETTING_DIRECTORY
+
+  void init(const YAML::Node& config);   // e.g., init(YAML::Load("RandSeed: 1\n...")) in the tests
 
   std::random_device::result_type getRandSeed() const {  return rand_seed; }
   bool isShowRandSeed() const { return is_show_rand_seed; }
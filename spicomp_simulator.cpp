@@ -2,6 +2,13 @@
 
 #include "util/rng.h"
 #include "util/stl.h"
+#include "util/parallel.h"
+
+
+// the drone states in all precisions are available to the planner and the plan storage
+template class BasicDroneState<DoublePrecision>;
+template class BasicDroneState<FloatPrecision>;
+template class BasicDroneState<QuantizedPrecision<QUANTIZED_GEOMETRY_STEP_MILLI>>;
 
 
 void translate(FrameSeq& frame, double x, double y, double z) {
@@ -12,38 +19,48 @@ void translate(FrameSeq& frame, double x, double y, double z) {
 
 
 // -------------------------------------------------------------------------------------------
-//   Frame Tree
+//   Drone Assignment
 // -------------------------------------------------------------------------------------------
 
-void FrameTree::attachFrameSubtreeToTerminalFrame(const FrameTree& subtree, int subtree_root_frame_id) {
-  assert(!subtree.empty());
-  assert(isFrameExist(subtree_root_frame_id));
-  assert(!isDecisionFrame(subtree_root_frame_id));
-  assert(isTerminalFrame(subtree_root_frame_id));  // must be terminal for this function
+void DroneAssignment::assign(int pixel_id, int drone_id) {
+  assert(0 <= drone_id && drone_id < getDroneNum());
+  assert(pixel_ids[drone_id] < 0 || pixel_ids[drone_id] == pixel_id);
+  unassign(pixel_id);
+  drone_ids[pixel_id] = drone_id;
+  pixel_ids[drone_id] = pixel_id;
+  assigned_drone_ids.set(drone_id);
+  unassigned_drone_ids.reset(drone_id);
+}
 
-  if (subtree.isTerminalFrame(subtree_root_frame_id)) return;  // single frame subtree, do nothing
 
-  if (subtree.isDecisionFrame(subtree_root_frame_id)) {
-    auto& decision_variable = subtree.getDecisionVariable(subtree_root_frame_id);
-    setDecisionVariable(subtree_root_frame_id, decision_variable);
+void DroneAssignment::unassign(int pixel_id) {
+  auto drone_id = drone_ids[pixel_id];
+  if (drone_id < 0) return;
+  drone_ids[pixel_id] = -1;
+  pixel_ids[drone_id] = -1;
+  assigned_drone_ids.reset(drone_id);
+  unassigned_drone_ids.set(drone_id);
+}
 
-    for(auto [option, child_frame_id] : subtree.getAllChildrenIdsWithOptions(subtree_root_frame_id)) {
-      assert(decision_variable.contains(option));
-      assert(!isFrameExist(child_frame_id));
-      addFrame(subtree.getFrame(child_frame_id));
-      addChildId(subtree_root_frame_id, option, child_frame_id);
-      attachFrameSubtreeToTerminalFrame(subtree, child_frame_id);
-    }
-  } else {  // subtree_root_frame is not a decision frame
-    // there is only one child frame
-    auto& child_frame = subtree.getUniqueChildFrame(subtree_root_frame_id);
-    addFrame(child_frame);
-    addUniqueChildId(subtree_root_frame_id, child_frame.getId());
-    attachFrameSubtreeToTerminalFrame(subtree, child_frame.getId());
-  }
+
+void DroneAssignment::swapDroneIds(int drone_id1, int drone_id2) {
+  auto pixel_id1 = pixel_ids[drone_id1];
+  auto pixel_id2 = pixel_ids[drone_id2];
+  if (pixel_id1 >= 0) drone_ids[pixel_id1] = drone_id2;
+  if (pixel_id2 >= 0) drone_ids[pixel_id2] = drone_id1;
+  pixel_ids[drone_id1] = pixel_id2;
+  pixel_ids[drone_id2] = pixel_id1;
+  assigned_drone_ids.set(drone_id1, pixel_id2 >= 0);
+  assigned_drone_ids.set(drone_id2, pixel_id1 >= 0);
+  unassigned_drone_ids.set(drone_id1, pixel_id2 < 0);
+  unassigned_drone_ids.set(drone_id2, pixel_id1 < 0);
 }
 
 
+// -------------------------------------------------------------------------------------------
+//   Frame Tree
+// -------------------------------------------------------------------------------------------
+
 void FrameTree::attachFrameSubtree(const FrameTree& subtree, int subtree_root_frame_id, const DecisionVariable& new_decision_variable,
                                    DecisionOption option_for_unique_child_in_original, DecisionOption option_for_unique_child_in_subtree)
 {
@@ -66,13 +83,13 @@ void FrameTree::attachFrameSubtree(const FrameTree& subtree, int subtree_root_fr
       auto& child_decision_variable = subtree.getDecisionVariable(subtree_root_frame_id);
       assert(child_decision_variable.isSubdomainOf(new_decision_variable));
       // make sure no unknown option in new_decision_variable
-      for(auto& option : new_decision_variable.getDomains()) {
+      for(auto option : new_decision_variable.getDomains()) {
         assert(old_decision_variable.contains(option) || child_decision_variable.contains(option));
       }
     } else {
       assert(new_decision_variable.contains(option_for_unique_child_in_subtree));
       // make sure no unknown option in new_decision_variable
-      for(auto& option : new_decision_variable.getDomains()) {
+      for(auto option : new_decision_variable.getDomains()) {
         assert(old_decision_variable.contains(option) || option == option_for_unique_child_in_subtree);
       }
     }
@@ -89,185 +106,80 @@ void FrameTree::attachFrameSubtree(const FrameTree& subtree, int subtree_root_fr
       auto& child_decision_variable = subtree.getDecisionVariable(subtree_root_frame_id);
       assert(child_decision_variable.isSubdomainOf(new_decision_variable));
       // make sure no unknown option in new_decision_variable
-      for(auto& option : new_decision_variable.getDomains()) {
+      for(auto option : new_decision_variable.getDomains()) {
         assert(option == option_for_unique_child_in_original || child_decision_variable.contains(option));
       }
     } else {
       assert(option_for_unique_child_in_subtree != DecisionVariable::NIL);
       assert(new_decision_variable.contains(option_for_unique_child_in_subtree));
       // make sure no unknown option in new_decision_variable
-      for(auto& option : new_decision_variable.getDomains()) {
+      for(auto option : new_decision_variable.getDomains()) {
         assert(option == option_for_unique_child_in_original || option == option_for_unique_child_in_subtree);
       }
     }
     // update children_ids_db
-    auto& child_frame = getUniqueChildFrame(subtree_root_frame_id);
-    addChildId(subtree_root_frame_id, option_for_unique_child_in_original, child_frame.getId());
+    auto child_frame_id = getUniqueChildFrameId(subtree_root_frame_id);
+    removeUniqueChildId(subtree_root_frame_id, child_frame_id);
     // must use the new decision variable
     setDecisionVariable(subtree_root_frame_id, new_decision_variable);
+    addChildId(subtree_root_frame_id, option_for_unique_child_in_original, child_frame_id);
   }
 
   // now add the child frames in the subtree
   if (option_for_unique_child_in_subtree == DecisionVariable::NIL) {
     auto& child_decision_variable = subtree.getDecisionVariable(subtree_root_frame_id);
-    for(auto& option : new_decision_variable.getDomains()) {
+    for(auto option : new_decision_variable.getDomains()) {
       if (child_decision_variable.contains(option)) {
         auto &child_frame = subtree.getChildFrame(subtree_root_frame_id, option);
         assert(!isFrameExist(child_frame.getId()));
-        addFrame(child_frame);
+        addNode(subtree.getPayload(child_frame.getId()));   // with its game state
         addChildId(subtree_root_frame_id, option, child_frame.getId());
-        attachFrameSubtreeToTerminalFrame(subtree, child_frame.getId());  // since child_frame is terminal in this tree.
+        attachSubtreeToTerminalNode(subtree, child_frame.getId());  // since child_frame is terminal in this tree.
       }  // else option must be in old_decision_variable -> do nothing
     }
   } else {  // option_for_unique_child_in_subtree != DecisionVariable::NIL
     // there is only one child frame
     auto& child_frame = subtree.getUniqueChildFrame(subtree_root_frame_id);
     assert(!isFrameExist(child_frame.getId()));
-    addFrame(child_frame);
+    addNode(subtree.getPayload(child_frame.getId()));   // with its game state
     addChildId(subtree_root_frame_id, option_for_unique_child_in_subtree, child_frame.getId());
-    attachFrameSubtreeToTerminalFrame(subtree, child_frame.getId());
-  }
-
-  assert(isValid());
-}
-
-
-void FrameTree::deleteFrameSubtree(int frame_id) {
-  // __vv__(frame_id);
-  assert(isFrameExist(frame_id));
-  if (root_frame_id == frame_id) {   // delele everything
-    clear();
-  } else {
-    if (isDecisionFrame(frame_id)) {
-      if (!isTerminalFrame(frame_id)) {
-        auto option_and_child_frame_id = getAllChildrenIdsWithOptions(frame_id);
-        for (auto [option, child_frame_id]: option_and_child_frame_id) {
-          removeChildId(frame_id, option, child_frame_id);
-          deleteFrameSubtree(child_frame_id);
-        }
-      }
-    } else {
-      if (!isTerminalFrame(frame_id)) {
-        auto child_frame_id = getUniqueChildFrameId(frame_id);
-        removeUniqueChildId(frame_id, child_frame_id);
-        deleteFrameSubtree(child_frame_id);
-      }
-    }
-    assert(isTerminalFrame(frame_id));  // must have no child
-    if (isDecisionFrame(frame_id)) {
-      removeDecisionVariable(frame_id);
-    }
-    removeFrame(frame_id);
+    attachSubtreeToTerminalNode(subtree, child_frame.getId());
   }
-}
-
 
-void FrameTree::pop_front() {
-  assert(!empty());
-  if (size() == 1) {
-    clear(); // just remove everything
-  } else {
-    if (isDecisionFrame(root_frame_id)) {
-      auto& next_frame = getDefaultChildFrame(root_frame_id);
-      auto& decision_variable = getDecisionVariable(root_frame_id);
-      auto& default_option = getDefaultOption(root_frame_id);
-      for(auto& option : getDecisionVariable(root_frame_id).getDomains()) {
-        if (option != default_option) {
-          auto& ignored_child_frame = getChildFrame(root_frame_id, option);
-          removeChildId(root_frame_id, option, ignored_child_frame.getId());  // cut ties with the next frame before delete the subtree.
-          deleteFrameSubtree(ignored_child_frame.getId());
-        } else {
-          removeChildId(root_frame_id, option, next_frame.getId());   // just cut ties with the next frame
-        }
-      }
-      removeDecisionVariable(root_frame_id);
-      removeFrame(root_frame_id);
-      setRootFrameId(next_frame.getId());
-    } else {  // not a decision frame
-      auto& next_frame = getUniqueChildFrame(root_frame_id);
-      removeUniqueChildId(root_frame_id, next_frame.getId());
-      removeFrame(root_frame_id);
-      setRootFrameId(next_frame.getId());
-    }
-  }
   assert(isValid());
 }
 
 
-bool FrameTree::isValid() const {
-  std::vector<int> visited_frame_ids;
-  if (!isValid(root_frame_id, visited_frame_ids)) return false;
-  if (size() != visited_frame_ids.size()) return false;
-  for(auto& [frame_id, _] : frame_decision_var_db) {
-    if (!isFrameExist(frame_id)) return false;
-  }
-  for(auto& [frame_id, _] : children_ids_db) {
-    if (!isFrameExist(frame_id)) return false;
-  }
-  for(auto& [frame_id, _] : parent_frame_id_db) {
-    if (!isFrameExist(frame_id)) return false;
-  }
-  for(auto& [frame_id, _] : parent_option_db) {
-    if (!isFrameExist(frame_id)) return false;
-  }
-  return true;
-}
-
-
-bool FrameTree::isValid(int frame_id, std::vector<int>& visited_frame_ids) const {
-  if (std::find(visited_frame_ids.begin(), visited_frame_ids.end(), frame_id) != visited_frame_ids.end()) { return false; } // should not visit again
-  if (!isFrameExist(frame_id)) return false;
-
-  visited_frame_ids.push_back(frame_id);
-
-  if (hasParentFrameId(frame_id)) {
-    if (!parent_option_db.contains(frame_id)) return false;
-    auto parent_id = getParentFrameId(frame_id);
-    if (isDecisionFrame(parent_id)) {
-      if (getChildFrameId(parent_id, getParentOption(frame_id)) != frame_id) return false;
-    } else {
-      if (getUniqueChildFrameId(parent_id) != frame_id) return false;
-    }
-  }
-
-  // no need to check frame_decision_var_db
-
-  if (!isTerminalFrame(frame_id)) {
-    if (isDecisionFrame(frame_id)) {  // have children
-      auto& decision_variable = getDecisionVariable(frame_id);
-      for(auto [option, child_id]: getAllChildrenIdsWithOptions(frame_id)) {
-        if (option == DecisionVariable::NIL) return false;
-        if (!decision_variable.contains(option)) return false;
-        if (!isValid(child_id, visited_frame_ids)) return false;
-      }
-    } else {
-      auto& my_children_ids_db = getAllChildrenIdsWithOptions(frame_id);
-      if (my_children_ids_db.size() != 1) return false;
-      if (!my_children_ids_db.contains(DecisionVariable::NIL)) return false;
-      auto child_id = getUniqueChildFrameId(frame_id);
-      if (!isValid(child_id, visited_frame_ids)) return false;
-    }
-  } // else terminal frame, no need to test
-
-  return true;
-}
-
-
 void FrameTree::print() const {
   std::cout << "------ Frame Tree Begin ------" << std::endl;
   if (empty()) {
-    assert(root_frame_id < 0);
+    assert(getRootFrameId() < 0);
     std::cout << "Empty frame tree." << std::endl;
   } else {
-    assert(root_frame_id >= 0);
-    std::cout << "root_frame_id=" << root_frame_id << std::endl;
-    print(0, root_frame_id);
+    assert(getRootFrameId() >= 0);
+    std::cout << "root_frame_id=" << getRootFrameId() << std::endl;
+    std::vector<std::pair<int, int>> stack = { { getRootFrameId(), 0 } };   // (frame_id, indent_size)
+    while(!stack.empty()) {
+      auto [frame_id, indent_size] = stack.back();
+      stack.pop_back();
+      if (hasParentFrameId(frame_id) && isDecisionFrame(getParentFrameId(frame_id))) {
+        int parent_frame_id = getParentFrameId(frame_id);
+        std::cout << indent(indent_size-1) << "- v" << getDecisionVariable(parent_frame_id).getId() << "=" << getParentOption(frame_id) << " in Frame" << parent_frame_id << ":" << std::endl;
+      }
+      printFrame(indent_size, frame_id);
+      if (isTerminalFrame(frame_id)) continue;
+      std::vector<int> child_ids;
+      for(auto [option, child_id] : getAllChildrenIdsWithOptions(frame_id)) { child_ids.push_back(child_id); }
+      for(auto iter = child_ids.rbegin(); iter != child_ids.rend(); iter++) {   // print the children in the order of the options
+        stack.push_back({ *iter, indent_size+1 });
+      }
+    }
   }
   std::cout << "------ Frame Tree End ------" << std::endl;
 }
 
 
-void FrameTree::print(int indent_size, int frame_id) const {
+void FrameTree::printFrame(int indent_size, int frame_id) const {
   assert(isFrameExist(frame_id));
   std::cout << indent(indent_size) << "Frame" << frame_id;
   if (isDecisionFrame(frame_id)) {
@@ -280,7 +192,6 @@ void FrameTree::print(int indent_size, int frame_id) const {
     int parent_frame_id = getParentFrameId(frame_id);
     assert(parent_frame_id >= 0);
     std::cout << "  Parent=";
-    assert(parent_option_db.contains(frame_id));
     if (getParentOption(frame_id) >= 0) {
       std::cout << getParentOption(frame_id) << "->";
       assert(getChildFrameId(parent_frame_id, getParentOption(frame_id)) == frame_id);
@@ -296,17 +207,8 @@ void FrameTree::print(int indent_size, int frame_id) const {
     assert(!isDecisionFrame(frame_id));
     std::cout << "  Terminal" << std::endl;
   } else {
+    assert(isDecisionFrame(frame_id) || hasChildNilOption(frame_id));
     std::cout << ":" << std::endl;
-    if (isDecisionFrame(frame_id)) {
-      for(auto [option , child_id]: getAllChildrenIdsWithOptions(frame_id)) {
-        std::cout << indent(indent_size) << "- v" << getDecisionVariable(frame_id).getId() << "=" << option << " in Frame" << frame_id << ":" << std::endl;
-        print(indent_size+1, child_id);
-      }
-    } else {
-      assert(hasChildNilOption(frame_id));
-      // std::cout << indent(indent_size) << "- Frame" << frame_id << " Nil" << ":" << std::endl;
-      print(indent_size+1, getUniqueChildFrame(frame_id).getId());
-    }
   }
 }
 
@@ -349,7 +251,7 @@ const std::vector<Pos3D> GameState::gun_trajectory = [] {
   auto rng = std::mt19937{dev()};
   std::uniform_real_distribution<> rand_gen(-100.0, 100.0);
 
-  for(int i=0; i<trajectory.size(); i++) {
+  for(std::size_t i=0; i<trajectory.size(); i++) {
     auto dx = rand_gen(rng);
     auto dy = rand_gen(rng);
     trajectory[i].translate(dx, dy, 0.0);
@@ -358,6 +260,63 @@ const std::vector<Pos3D> GameState::gun_trajectory = [] {
   return trajectory;
 }();
 
+const std::vector<GameState::GunState> GameState::gun_state_table = GameState::makeGunStateTable();   // must be initialized after gun_trajectory
+
+
+std::vector<GameState::GunState> GameState::makeGunStateTable() {
+  int pos_num = gun_trajectory.size();
+  std::vector<GunState> table(pos_num * POWER_LEVEL_NUM);
+
+  for(int pos_id = 0; pos_id < pos_num; pos_id++) {
+    for(int power_level_id = 0; power_level_id < POWER_LEVEL_NUM; power_level_id++) {
+      auto& gun_state = table[getGunStateId(pos_id, power_level_id)];
+
+      int next_pos_id = (pos_id + 1 < pos_num) ? pos_id + 1 : 0;
+      int next_power_level_id = (power_level_id + 1 < POWER_LEVEL_NUM) ? power_level_id + 1 : 0;
+      gun_state.next_gun_state_id = getGunStateId(next_pos_id, next_power_level_id);
+      gun_state.is_decision = (power_level_id == 2);
+      gun_state.new_bullet_pos = gun_trajectory[next_pos_id];
+      gun_state.new_bullet_pos.translate(50.0, 50.0, 125.0);
+
+      auto gun_color = COLOR_GREEN;
+      auto power_color = COLOR_RED;
+
+      std::vector<Color3D> gun_colors(3, gun_color);
+      if (power_level_id < 3) {
+        gun_colors[power_level_id] = power_color;
+      }
+
+      std::vector<Pixel> gun_pixels;
+
+      gun_pixels.emplace_back(  0.0,   0.0,  0.0, gun_colors[0]);
+      gun_pixels.emplace_back( 50.0,   0.0,  0.0, gun_colors[0]);
+      gun_pixels.emplace_back(100.0,   0.0,  0.0, gun_colors[0]);
+      gun_pixels.emplace_back(  0.0,  50.0,  0.0, gun_colors[0]);
+      gun_pixels.emplace_back(  0.0, 100.0,  0.0, gun_colors[0]);
+      gun_pixels.emplace_back( 50.0, 100.0,  0.0, gun_colors[0]);
+      gun_pixels.emplace_back(100.0,  50.0,  0.0, gun_colors[0]);
+      gun_pixels.emplace_back(100.0, 100.0,  0.0, gun_colors[0]);
+
+      gun_pixels.emplace_back( 25.0,  25.0, 50.0, gun_colors[1]);
+      gun_pixels.emplace_back( 75.0,  25.0, 50.0, gun_colors[1]);
+      gun_pixels.emplace_back( 25.0,  75.0, 50.0, gun_colors[1]);
+      gun_pixels.emplace_back( 75.0,  75.0, 50.0, gun_colors[1]);
+
+      gun_pixels.emplace_back( 50.0,  50.0, 100.0, gun_colors[2]);
+
+      FrameBuilder builder;
+      builder.reserve(gun_pixels.size());
+      for(std::size_t i = 0; i < gun_pixels.size(); i++) {
+        gun_pixels[i].translate(gun_trajectory[pos_id]);
+        builder.addPixel(gun_pixels[i], i);
+      }
+      gun_state.frame = builder.build();
+    }
+  }
+
+  return table;
+}
+
 //const std::vector<Pos3D> GameState::gun_trajectory = [] {
 //  std::vector<Pos3D> trajectory;
 //  trajectory.emplace_back(   0.0,-200.0,   0.0);
@@ -418,87 +377,561 @@ const std::vector<Pos3D> GameState::gun_trajectory = [] {
 
 
 // -------------------------------------------------------------------------------------------
-//   Game State Tree
+//   Game Controller
 // -------------------------------------------------------------------------------------------
 
-void GameStateTree::deleteGameStateSubtree(int game_state_id) {
-  assert(isGameStateExist(game_state_id));
-  if (root_game_state_id == game_state_id) {
-    clear();
+void GameController::growInitFrameTree() {
+  assert(frame_tree.size() == 1);
+  for(int i=0; i<=INIT_FRAMETREE_LENGTH; i++) {
+    expandFrontier(frame_tree.getTerminalFrameIds());
+  }
+  assert(frame_tree.isValid());
+}
+
+
+void GameController::expandFrontier(std::span<const int> frame_ids) {
+  // reserve the id ranges of each game state by prefix sums, in the same order as a serial expansion
+  int first_id = next_game_state_id;
+  std::vector<int> first_game_state_ids(frame_ids.size());
+  std::vector<int> first_decision_variable_ids(frame_ids.size());
+  for(std::size_t i=0; i<frame_ids.size(); i++) {
+    assert(frame_tree.isTerminalFrame(frame_ids[i]));
+    bool is_decision_game_state = frame_tree.getGameState(frame_ids[i]).isDecisionGameState();
+    first_game_state_ids[i] = next_game_state_id;
+    first_decision_variable_ids[i] = next_decision_variable_id;
+    next_game_state_id += is_decision_game_state ? 2 : 1;
+    next_decision_variable_id += is_decision_game_state ? 1 : 0;
+  }
+
+  std::vector<GameStateExpansion> expansions(frame_ids.size());
+  parallel_for(frame_ids.size(), [&](int i) {
+    expansions[i] = expandGameState(frame_ids[i], first_game_state_ids[i], first_decision_variable_ids[i]);
+  }, FRONTIER_EXPANSION_GRAIN_SIZE);
+
+  // merge in bulk; frame_ids may be the terminal ids of the frame tree, which change from here on
+  frame_tree.reserve(frame_tree.size() + next_game_state_id - first_id);
+  for(auto& expansion : expansions) {
+    mergeGameStateExpansion(expansion);
+  }
+}
+
+
+GameController::GameStateExpansion GameController::expandGameState(int game_state_id, int first_game_state_id, int first_decision_variable_id) const {
+  GameStateExpansion expansion;
+  expansion.game_state_id = game_state_id;
+
+  auto& game_state = frame_tree.getGameState(game_state_id);
+  int next_id = first_game_state_id;
+  if (game_state.isDecisionGameState()) {
+    int next_variable_id = first_decision_variable_id;
+    expansion.decision_variable = game_state.getDecisionVariable(next_variable_id);
+    assert(expansion.decision_variable.getId() == first_decision_variable_id);
+    for(auto& [option, next_game_state] : game_state.getNextGameStates(expansion.decision_variable, next_id)) {
+      expansion.next_frames.push_back(next_game_state.makeFrame());
+      expansion.next_game_states.emplace_back(option, next_game_state);
+    }
+    assert(next_id == first_game_state_id + 2);
   } else {
-    if (!isTerminalGameState(game_state_id)) {
-      for (auto [option, child_frame_id]: getChildrenIds(game_state_id)) {
-        deleteGameStateSubtree(child_frame_id);
-      }
+    auto next_game_state = game_state.getUniqueNextGameState(next_id);
+    expansion.next_frames.push_back(next_game_state.makeFrame());
+    expansion.next_game_states.emplace_back(DecisionVariable::NIL, next_game_state);
+    assert(next_id == first_game_state_id + 1);
+  }
+  return expansion;
+}
+
+
+void GameController::mergeGameStateExpansion(GameStateExpansion& expansion) {
+  auto game_state_id = expansion.game_state_id;    // the frame id is the same as the game state id
+  if (expansion.decision_variable.isExist()) {
+    decision_variable_list.insert({ expansion.decision_variable.getId(), expansion.decision_variable });
+    frame_tree.setDecisionVariable(game_state_id, expansion.decision_variable);
+  }
+  for(std::size_t i=0; i<expansion.next_game_states.size(); i++) {
+    auto& [option, next_game_state] = expansion.next_game_states[i];
+    frame_tree.addGameFrame(next_game_state, std::move(expansion.next_frames[i]));
+    frame_tree.addChildId(game_state_id, option, next_game_state.getId());
+  }
+  expansion.next_frames.clear();
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Formation
+// -------------------------------------------------------------------------------------------
+
+Formation& Formation::operator=(Formation&& formation) {
+  if (this == &formation) return *this;
+  if (getResource() == formation.getResource()) {
+    drone_num = formation.drone_num;
+    chunks = std::move(formation.chunks);
+    formation.clear();
+  } else {   // the chunks cannot be shared across memory resources
+    copyChunks(formation);
+  }
+  return *this;
+}
+
+
+Formation::Formation(const Formation& formation, ChunkTranslation& translation, const allocator_type& alloc) :
+    drone_num{formation.drone_num}, chunks(alloc)
+{
+  chunks.reserve(formation.chunks.size());
+  for(auto& chunk : formation.chunks) {
+    auto& new_chunk = translation[chunk.get()];
+    if (!new_chunk) {
+      new_chunk = std::allocate_shared<Chunk>(std::pmr::polymorphic_allocator<Chunk>(getResource()), *chunk);
     }
-    game_state_db.erase(game_state_id);
-    decision_variable.erase(game_state_id);
-    children_ids.erase(game_state_id);
+    chunks.push_back(new_chunk);
+  }
+}
+
+
+void Formation::setDroneState(int drone_id, const Pos3D& pos, const Color3D& color) {
+  if (std::as_const(*this).getDroneState(drone_id).isSameAs(pos, color)) return;
+  auto& new_drone_state = getDroneState(drone_id);
+  new_drone_state.setPos(pos);
+  new_drone_state.setColor(color);
+}
+
+
+void Formation::addDroneState(const DroneState& drone_state) {
+  if (drone_num % FORMATION_CHUNK_SIZE == 0) {
+    chunks.push_back(std::allocate_shared<Chunk>(std::pmr::polymorphic_allocator<Chunk>(getResource())));
+  }
+  getUniqueChunk(drone_num / FORMATION_CHUNK_SIZE).drone_states[drone_num % FORMATION_CHUNK_SIZE] = drone_state;
+  drone_num++;
+}
+
+
+Formation::Chunk& Formation::getUniqueChunk(int chunk_id) {
+  auto& chunk = chunks[chunk_id];
+  if (chunk.use_count() > 1) {
+    chunk = std::allocate_shared<Chunk>(std::pmr::polymorphic_allocator<Chunk>(getResource()), *chunk);
   }
+  return *chunk;
 }
 
 
-void GameStateTree::pop_front() {
-  assert(!empty());
-  if (size() == 1) {
-    clear(); // just remove everything
+void Formation::copyChunks(const Formation& formation) {
+  drone_num = formation.drone_num;
+  if (getResource() == formation.getResource()) {
+    chunks.assign(formation.chunks.begin(), formation.chunks.end());
   } else {
-    if (isDecisionGameState(root_game_state_id)) {
-      auto& default_option = getDecisionVariable(root_game_state_id).getDefaultOption();
-      auto& next_game_state = getChildGameState(root_game_state_id, default_option);
-      for(auto& option : getDecisionVariable(root_game_state_id).getDomains()) {
-        if (option != default_option) {
-          auto& ignored_child_frame = getChildGameState(root_game_state_id, option);
-          deleteGameStateSubtree(ignored_child_frame.getId());
-        }
-      }
-      game_state_db.erase(root_game_state_id);
-      decision_variable.erase(root_game_state_id);
-      children_ids.erase(root_game_state_id);
-      root_game_state_id = next_game_state.getId();
-    } else {
-      auto& next_game_state = getChildGameState(root_game_state_id);
-      game_state_db.erase(root_game_state_id);
-      assert(!decision_variable.contains(root_game_state_id));
-      children_ids.erase(root_game_state_id);
-      root_game_state_id = next_game_state.getId();
+    chunks.clear();
+    for(auto& chunk : formation.chunks) {
+      chunks.push_back(std::allocate_shared<Chunk>(std::pmr::polymorphic_allocator<Chunk>(getResource()), *chunk));
     }
   }
 }
 
 
 // -------------------------------------------------------------------------------------------
-//   The SPICOMP algorithm
+//   Formation Plan
 // -------------------------------------------------------------------------------------------
 
-bool SpicompPlanner::solve(int frame_id, const Formation& formation, const DroneAssignment& assignment, int search_depth) {
-  assert(frame_tree.isFrameExist(frame_id));
+FormationPlan::FormationPlan(const FormationPlan& plan, Formation::ChunkTranslation& translation, const allocator_type& alloc) :
+    formation1(plan.formation1, translation, alloc), micro_formation_seq(alloc), frame1_id{plan.frame1_id}, frame2_id{plan.frame2_id},
+    assignment1(plan.assignment1), assignment2(plan.assignment2), hidden_since_depths(plan.hidden_since_depths)
+{
+  micro_formation_seq.reserve(plan.micro_formation_seq.size());
+  for(auto& formation : plan.micro_formation_seq) {
+    micro_formation_seq.emplace_back(formation, translation);
+  }
+}
 
-  // The depth-first search
-  if (frame_tree.isTerminalFrame(frame_id)) { return true; }
-  for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
-    cf_plan.emplaceFormationPlan(frame_id, child_frame_id);
-    auto& fplan = cf_plan.getFormationPlan(frame_id, child_frame_id);
-    computeFormationPlan(fplan, frame_tree.getFrame(frame_id), frame_tree.getFrame(child_frame_id), formation, assignment);
 
-    auto& formation2 = fplan.getFormation2();
-    auto& assignment2 = fplan.getAssignment2();
-    if (!solve(child_frame_id, formation2, assignment2, search_depth+1)) return false;
+void FormationPlan::swapDroneIds(int drone_id1, int drone_id2, bool is_swap_formation1, int first_micro_frame_id) {
+  assert(!is_swap_formation1 || first_micro_frame_id == 0);
+  if (is_swap_formation1) {
+    formation1.swapDroneStates(drone_id1, drone_id2);
+    assignment1.swapDroneIds(drone_id1, drone_id2);
+  }
+  for(int micro_frame_id = first_micro_frame_id; micro_frame_id < static_cast<int>(micro_formation_seq.size()); micro_frame_id++) {   // the earlier ones have been shown
+    micro_formation_seq[micro_frame_id].swapDroneStates(drone_id1, drone_id2);
+  }
+  assignment2.swapDroneIds(drone_id1, drone_id2);
+  if (!hidden_since_depths.empty()) {
+    std::swap(hidden_since_depths[drone_id1], hidden_since_depths[drone_id2]);
+  }
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Formation Plan Cache
+// -------------------------------------------------------------------------------------------
+
+const std::vector<Pos3D>* FormationPlanCache::find(std::size_t fingerprint) {
+  auto iter = entry_db.find(fingerprint);
+  if (iter == entry_db.end()) return nullptr;
+  entry_list.splice(entry_list.begin(), entry_list, iter->second);   // move the entry to the front
+  return &(iter->second->second);
+}
+
+
+void FormationPlanCache::insert(std::size_t fingerprint, std::vector<Pos3D> drone_positions) {
+  auto iter = entry_db.find(fingerprint);
+  if (iter != entry_db.end()) {
+    iter->second->second = std::move(drone_positions);
+    entry_list.splice(entry_list.begin(), entry_list, iter->second);
+    return;
+  }
+  if (capacity == 0) return;   // disabled
+  if (entry_db.size() >= static_cast<std::size_t>(capacity)) {   // evict the least recently used entry
+    entry_db.erase(entry_list.back().first);
+    entry_list.pop_back();
   }
+  entry_list.emplace_front(fingerprint, std::move(drone_positions));
+  entry_db[fingerprint] = entry_list.begin();
+}
+
+
+std::size_t FormationPlanCache::makeFingerprint(const Frame& frame2, const DroneAssignment& partial_assignment2) {
+  assert(frame2.size() == partial_assignment2.size());
+  std::size_t seed = 0;
+  for(int pixel_id = 0; pixel_id < partial_assignment2.size(); pixel_id++) {
+    if (partial_assignment2[pixel_id] >= 0) continue;   // a persistent pixel
+    hash_combine(seed, makeCellKey(frame2.getPos(pixel_id)));
+  }
+  return seed;
+}
+
+
+std::size_t FormationPlanCache::makeCellKey(const Pos3D& pos) {
+  auto quantize = [](double v) { return static_cast<long>(std::floor(v / FORMATION_PLAN_CACHE_QUANTUM)); };
+  std::size_t seed = 0;
+  hash_combine(seed, quantize(pos.x));
+  hash_combine(seed, quantize(pos.y));
+  hash_combine(seed, quantize(pos.z));
+  return seed;
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Contingency Formation Plan
+// -------------------------------------------------------------------------------------------
 
+bool ContingencyFormationPlan::emplaceFormationPlan(int frame1_id, int frame2_id) {
+  if (isFull()) return false;
+  auto& slot_id = getSlotIdRef(*storage, frame2_id);
+  assert(slot_id < 0);   // a child frame has only one parent frame
+  auto& formation_plans = storage->formation_plans;
+  auto& free_slot_ids = storage->free_slot_ids;
+  if (free_slot_ids.empty()) {
+    slot_id = formation_plans.size();
+    formation_plans.emplace_back(frame1_id, frame2_id);
+  } else {
+    slot_id = free_slot_ids.back();
+    free_slot_ids.pop_back();
+    formation_plans[slot_id] = FormationPlan(frame1_id, frame2_id, formation_plans.get_allocator());
+  }
+  storage->plan_num++;
   return true;
 }
 
 
+int& ContingencyFormationPlan::getSlotIdRef(Storage& storage, int frame2_id) {
+  auto& slot_ids = storage.slot_ids;
+  if (slot_ids.empty()) {
+    storage.first_frame2_id = frame2_id;
+  } else if (frame2_id < storage.first_frame2_id) {
+    slot_ids.insert(slot_ids.begin(), storage.first_frame2_id - frame2_id, -1);
+    storage.first_frame2_id = frame2_id;
+  }
+  std::size_t i = frame2_id - storage.first_frame2_id;
+  if (i >= slot_ids.size()) {
+    slot_ids.resize(i + 1, -1);
+  }
+  return slot_ids[i];
+}
+
+
+void ContingencyFormationPlan::removeFormationPlan(int frame2_id) {
+  auto& slot_id = storage->slot_ids[frame2_id - storage->first_frame2_id];
+  assert(slot_id >= 0);
+  storage->formation_plans[slot_id] = FormationPlan();   // release the chunks of the plan
+  storage->free_slot_ids.push_back(slot_id);
+  slot_id = -1;
+  storage->plan_num--;
+}
+
+
+void ContingencyFormationPlan::collectGarbage(const FrameTree& frame_tree) {
+  // remove the plans whose frames are no longer reachable from the root of frame_tree; the
+  // branches detached by pop_front() stay in frame_tree until they are reclaimed, but their plans
+  // are garbage already
+  auto& slot_ids = storage->slot_ids;
+  std::vector<bool> is_live(slot_ids.size(), false);
+  std::vector<int> frame_ids;
+  if (!frame_tree.empty()) frame_ids.push_back(frame_tree.getRootFrameId());
+  while(!frame_ids.empty()) {
+    int frame_id = frame_ids.back();
+    frame_ids.pop_back();
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+    for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+      if (isFormationPlanExist(frame_id, child_frame_id)) is_live[child_frame_id - storage->first_frame2_id] = true;
+      frame_ids.push_back(child_frame_id);
+    }
+  }
+  for(std::size_t i = 0; i < slot_ids.size(); i++) {
+    if (slot_ids[i] >= 0 && !is_live[i]) removeFormationPlan(storage->first_frame2_id + static_cast<int>(i));
+  }
+  auto first_iter = std::find_if(slot_ids.begin(), slot_ids.end(), [](int slot_id) { return slot_id >= 0; });
+  storage->first_frame2_id += first_iter - slot_ids.begin();
+  slot_ids.erase(slot_ids.begin(), first_iter);    // the ids of the removed frames will not come back
+  if (getMemorySize() <= max_memory_size || frame_tree.empty()) return;
+
+  // rank the plans of the current and the next frame first, since the simulator needs them to run
+  // to the next replan, and the others by the number of non-default options on their paths and
+  // then by their depths
+  struct RankedPlan { int frame1_id; int frame2_id; int non_default_num; int depth; };
+  std::vector<RankedPlan> ranked_plans;
+  std::vector<RankedPlan> stack = { { -1, frame_tree.getRootFrameId(), 0, -1 } };
+  while(!stack.empty()) {
+    auto parent_plan = stack.back();
+    stack.pop_back();
+    int frame_id = parent_plan.frame2_id;
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+    for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+      if (!isFormationPlanExist(frame_id, child_frame_id)) continue;
+      bool is_default = !frame_tree.isDecisionFrame(frame_id) || option == frame_tree.getDefaultOption(frame_id);
+      RankedPlan plan{ frame_id, child_frame_id, parent_plan.non_default_num + (is_default ? 0 : 1), parent_plan.depth + 1 };
+      ranked_plans.push_back(plan);
+      stack.push_back(plan);
+    }
+  }
+  std::sort(ranked_plans.begin(), ranked_plans.end(), [](auto& plan1, auto& plan2) {
+    return std::make_tuple(plan1.depth > 1, plan1.non_default_num, plan1.depth) < std::make_tuple(plan2.depth > 1, plan2.non_default_num, plan2.depth);
+  });   // a plan always comes after the plan of its parent frame
+
+  // copy the plans in this order into a new arena until it holds half of the ceiling, measured
+  // as the plans are copied, so that the garbage in the old arena does not shrink the share of
+  // the live plans
+  auto new_storage = std::make_unique<Storage>();
+  Formation::ChunkTranslation translation;
+  for(auto& plan : ranked_plans) {
+    if (plan.depth > 1 && new_storage->arena.getUsedSize() >= max_memory_size / 2) break;
+    getSlotIdRef(*new_storage, plan.frame2_id) = new_storage->formation_plans.size();
+    new_storage->formation_plans.emplace_back(getFormationPlan(plan.frame1_id, plan.frame2_id), translation);
+    new_storage->plan_num++;
+  }
+  storage = std::move(new_storage);
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   The SPICOMP algorithm
+// -------------------------------------------------------------------------------------------
+
+bool SpicompPlanner::solve() {
+  cf_plan.clear();
+  search_frame_ids.clear();
+
+  // The depth-first search. A chain of frames is followed in the inner loop, through the default
+  // child of each decision frame, so that the most likely path is planned first and is complete
+  // even if the search stops at the memory ceiling of cf_plan. The other children of a decision
+  // frame are kept in branches until the search comes back.
+  struct Branch {
+    int frame_id;
+    int child_frame_id;
+    const Formation* formation;
+    const DroneAssignment* assignment;
+    int search_depth;
+  };
+  std::vector<Branch> branches;
+
+  int frame_id = root_frame_id;
+  int child_frame_id = -1;   // the child of frame_id to search next, or -1 for the default child
+  const Formation* formation = &init_formation;
+  const DroneAssignment* assignment = &init_assignment;
+  bool is_complete = true;
+  while(true) {
+    while(!frame_tree.isTerminalFrame(frame_id)) {
+      search_frame_ids.push_back(frame_id);
+      if (child_frame_id < 0) {
+        child_frame_id = frame_tree.isDecisionFrame(frame_id) ? frame_tree.getDefaultChildFrameId(frame_id) : frame_tree.getUniqueChildFrameId(frame_id);
+        for(auto [option, other_child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+          if (other_child_frame_id == child_frame_id) continue;
+          branches.push_back({ frame_id, other_child_frame_id, formation, assignment, static_cast<int>(search_frame_ids.size()) });
+        }
+      }
+
+      if (!cf_plan.emplaceFormationPlan(frame_id, child_frame_id)) {   // the plan is full, so the remaining edges stay unplanned
+        is_complete = false;
+        break;
+      }
+      auto& fplan = cf_plan.getFormationPlan(frame_id, child_frame_id);
+      computeFormationPlan(fplan, frame_tree.getFrame(frame_id), frame_tree.getFrame(child_frame_id), *formation, *assignment);
+
+      frame_id = child_frame_id;
+      child_frame_id = -1;
+      formation = &fplan.getFormation2();    // the formation plans do not move when more plans are added
+      assignment = &fplan.getAssignment2();
+    }
+    if (!is_complete || branches.empty()) break;
+
+    // go back to the next child of the latest decision frame
+    auto branch = branches.back();
+    branches.pop_back();
+    search_frame_ids.resize(branch.search_depth - 1);
+    frame_id = branch.frame_id;
+    child_frame_id = branch.child_frame_id;
+    formation = branch.formation;
+    assignment = branch.assignment;
+  }
+  search_frame_ids.clear();
+
+  return is_complete;
+}
+
+
+const std::vector<StagingDemandCache::CellDemand>& StagingDemandCache::getFrameDemand(const FrameTree& frame_tree, int frame_id, int pixel_trajectory_tracking_num) {
+  if (pixel_trajectory_tracking_num != StagingDemandCache::pixel_trajectory_tracking_num) {
+    frame_demands.clear();
+    StagingDemandCache::pixel_trajectory_tracking_num = pixel_trajectory_tracking_num;
+  }
+  auto [iter, is_new] = frame_demands.try_emplace(frame_id);
+  if (!is_new) return iter->second;
+
+  // a pixel that persists from the parent frame keeps its drone, so only the new pixels need idle drones
+  // (without pixel identities, every pixel counts)
+  auto& frame = frame_tree.getFrame(frame_id);
+  auto& parent_frame = frame_tree.getFrame(frame_tree.getParentFrameId(frame_id));
+  bool has_identities = frame.hasPixelIdentities() && parent_frame.hasPixelIdentities();
+  std::unordered_set<int> parent_identities;
+  if (has_identities) {
+    for(int pixel_id = pixel_trajectory_tracking_num; pixel_id < parent_frame.size(); pixel_id++) {
+      parent_identities.insert(parent_frame.getPixelIdentity(pixel_id));
+    }
+  }
+  auto& cell_demands = iter->second;
+  auto xs = frame.getXs();
+  auto ys = frame.getYs();
+  auto zs = frame.getZs();
+  for(int pixel_id = pixel_trajectory_tracking_num; pixel_id < frame.size(); pixel_id++) {
+    if (has_identities && parent_identities.count(frame.getPixelIdentity(pixel_id)) > 0) continue;
+    auto cell_key = getGridCellKey(xs[pixel_id], ys[pixel_id], zs[pixel_id], STAGING_CELL_SIZE);
+    auto cell_iter = std::find_if(cell_demands.begin(), cell_demands.end(), [&](const CellDemand& cell) { return cell.cell_key == cell_key; });
+    if (cell_iter == cell_demands.end()) cell_iter = cell_demands.insert(cell_demands.end(), CellDemand{ cell_key, 0, Pos3D() });
+    cell_iter->pixel_num++;
+    cell_iter->pos_sum.translate(xs[pixel_id], ys[pixel_id], zs[pixel_id]);
+  }
+  return cell_demands;
+}
+
+
+void StagingDemandCache::collectGarbage(const FrameTree& frame_tree) {
+  std::erase_if(frame_demands, [&](const auto& entry) { return !frame_tree.isFrameExist(entry.first); });
+}
+
+
+void SpicompPlanner::computeStagingTargets() {
+  staging_targets.assign(drone_num, Pos3D());
+  has_staging_target = DynamicBitset(drone_num);
+  if (!is_staging_enabled) return;
+
+  std::vector<int> idle_drone_ids;   // the available drones that are hidden at the root frame
+  (init_assignment.getUnassignedDroneIds() & drone_availability).forEachSetBit([&](int drone_id) { idle_drone_ids.push_back(drone_id); });
+  if (idle_drone_ids.empty()) return;
+
+  // --- the upcoming demand in each grid cell, weighted by the probability of the frame and discounted by its depth ---
+
+  struct DemandCell {
+    double expected_pixel_num = 0.0;   // the expected number of new pixels in the frame tree
+    double weight = 0.0;               // the same, but discounted by the depth, which orders the cells
+    Pos3D center;                      // the weighted sum of the pixel positions until it is normalized
+    int idle_drone_num = 0;            // the idle drones in the cell already
+  };
+
+  struct SearchFrame {
+    int frame_id;
+    double probability;   // the branches of a decision frame are equally likely
+    int depth;
+  };
+
+  // the new pixels of each frame are counted once by staging_demand_cache, so this walk only adds up their cells
+  std::unordered_map<std::int64_t, DemandCell> demand_cells;
+  std::vector<SearchFrame> stack = { { root_frame_id, 1.0, 0 } };
+  while(!stack.empty()) {
+    auto [frame_id, probability, depth] = stack.back();
+    stack.pop_back();
+    if (depth > 0) {   // the pixels in the root frame are served already
+      double weight = probability / depth;   // a later frame may still be replanned before it is shown
+      for(auto& cell_demand : staging_demand_cache.getFrameDemand(frame_tree, frame_id, pixel_trajectory_tracking_num)) {
+        auto& cell = demand_cells[cell_demand.cell_key];
+        cell.expected_pixel_num += probability * cell_demand.pixel_num;
+        cell.weight += weight * cell_demand.pixel_num;
+        cell.center.translate(cell_demand.pos_sum.x * weight, cell_demand.pos_sum.y * weight, cell_demand.pos_sum.z * weight);
+      }
+    }
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+    auto& children = frame_tree.getAllChildrenIdsWithOptions(frame_id);
+    for(auto [option, child_frame_id] : children) {
+      stack.push_back({ child_frame_id, probability / children.size(), depth + 1 });
+    }
+  }
+  if (demand_cells.empty()) return;
+
+  // --- an idle drone in a demand cell has a short hop already, so it stays where it is ---
+
+  std::vector<std::pair<double, int>> movable_drones;   // (x, drone id) of the other idle drones
+  for(auto drone_id : idle_drone_ids) {
+    auto pos = init_formation.getDroneState(drone_id).getPos();
+    auto iter = demand_cells.find(getGridCellKey(pos.x, pos.y, pos.z, STAGING_CELL_SIZE));
+    if (iter != demand_cells.end()) {
+      iter->second.idle_drone_num++;
+    } else {
+      movable_drones.emplace_back(pos.x, drone_id);
+    }
+  }
+
+  std::vector<DemandCell> cells;   // the cells that expect more new pixels than they have idle drones
+  for(auto& [key, cell] : demand_cells) {
+    if (std::lround(cell.expected_pixel_num) <= cell.idle_drone_num) continue;
+    cell.center = Pos3D(cell.center.x / cell.weight, cell.center.y / cell.weight, cell.center.z / cell.weight);
+    cells.push_back(cell);
+  }
+  std::sort(cells.begin(), cells.end(), [](const DemandCell& c1, const DemandCell& c2) { return c1.weight > c2.weight; });
+
+  // --- the cells claim the nearest movable drones for their missing drones, the most urgent cell first ---
+
+  // the movable drones are sorted by x once, so that a search sweeps out from the x of a cell center
+  // in both directions and stops as soon as the gap in x alone is longer than the nearest distance
+  std::sort(movable_drones.begin(), movable_drones.end());
+  std::vector<bool> is_claimed(movable_drones.size(), false);
+  int movable_drone_num = movable_drones.size();
+  for(auto& cell : cells) {
+    int missing_drone_num = static_cast<int>(std::lround(cell.expected_pixel_num)) - cell.idle_drone_num;
+    for(int i = 0; i < missing_drone_num && movable_drone_num > 0; i++) {
+      auto first = std::lower_bound(movable_drones.begin(), movable_drones.end(), std::make_pair(cell.center.x, -1)) - movable_drones.begin();
+      int nearest = -1;
+      double nearest_distance = std::numeric_limits<double>::max();
+      auto visit = [&](int k) {
+        if (is_claimed[k]) return;
+        double distance = init_formation.getDroneState(movable_drones[k].second).getPos().distance(cell.center);
+        if (distance < nearest_distance) {
+          nearest = k;
+          nearest_distance = distance;
+        }
+      };
+      for(int k = first; k < static_cast<int>(movable_drones.size()) && movable_drones[k].first - cell.center.x < nearest_distance; k++) visit(k);
+      for(int k = first - 1; k >= 0 && cell.center.x - movable_drones[k].first < nearest_distance; k--) visit(k);
+      assert(nearest >= 0);
+      staging_targets[movable_drones[nearest].second] = cell.center;
+      has_staging_target.set(movable_drones[nearest].second);
+      is_claimed[nearest] = true;
+      movable_drone_num--;
+    }
+  }
+}
+
+
 bool SpicompPlanner::computeFormationPlan(FormationPlan& fplan, const Frame& frame1, const Frame& frame2, const Formation& formation1, const DroneAssignment& assignment1) {
   assert(frame1.size() == assignment1.size());
   assert(fplan.empty());
 
   // TODO: should reuse the previous cf_plan
 
-  auto& pixel1_set = frame1.getPixels();
-  auto& pixel2_set = frame2.getPixels();
-
   // initialize formation plan
   for(int frame_id=0; frame_id < micro_frame_num; frame_id++) {
     fplan.addMicroFormation(formation1);      // as a placeholder
@@ -509,34 +942,64 @@ bool SpicompPlanner::computeFormationPlan(FormationPlan& fplan, const Frame& fra
   // assignment to pixel
   assert(frame1.size() >= pixel_trajectory_tracking_num);
   assert(frame2.size() >= pixel_trajectory_tracking_num);
-  DroneAssignment assignment2(frame2.size(), -1);
+  DroneAssignment assignment2(frame2.size(), drone_num);
+  std::vector<bool> is_persistent_pixel(frame2.size(), false);   // whether a pixel in frame2 keeps its drone from frame1
   for(int pixel_id = 0; pixel_id < pixel_trajectory_tracking_num; pixel_id++) {
-    assignment2[pixel_id] = assignment1[pixel_id];    // assign to the same drones for trajectory tracking pixels
+    if (assignment1[pixel_id] < 0) continue;    // uncovered after a drone failure, so it is assigned as a new pixel
+    assignment2.assign(pixel_id, assignment1[pixel_id]);    // assign to the same drones for trajectory tracking pixels
+    is_persistent_pixel[pixel_id] = true;
   }
+  assignPersistentPixels(assignment2, is_persistent_pixel, frame1, frame2, assignment1);
 
   fplan.setAssignment2(assignment2);  // set a partial assignment2
 
-  std::unordered_map<int, std::vector<int>> earliest_available_frame_ids_db;
+  // the depth of frame1 since which each drone has been hidden, derived from the parent plan
+  int search_depth = static_cast<int>(search_frame_ids.size()) - 1;
+  auto hidden_since_depths = computeHiddenSinceDepths(assignment2, search_depth);
 
   // for the rest of the pixels:
-  if (assignment2.size() > pixel_trajectory_tracking_num) { // deal with the remaining pixels in frame2
+  if (!assignment2.isComplete()) { // deal with the remaining (new) pixels in frame2
 
-    // precompute the list of the earliest available frame ids
     auto unassigned_drone_ids = findUnassignedDroneIds(assignment2);
-    for(auto drone_id : unassigned_drone_ids) {
-      earliest_available_frame_ids_db[drone_id] = findEarliestAvailableFrameId(fplan, drone_id);
-      earliest_available_frame_ids_db[drone_id].push_back(frame2.getId());
+    std::size_t fingerprint = 0;
+    const std::vector<Pos3D>* cached_drone_positions = nullptr;
+    if (formation_plan_cache.isEnabled()) {
+      fingerprint = FormationPlanCache::makeFingerprint(frame2, assignment2);
+      cached_drone_positions = formation_plan_cache.find(fingerprint);
     }
 
-    // complete assignment2
-    for (int pixel_id = pixel_trajectory_tracking_num; pixel_id < assignment2.size(); pixel_id++) {
-      auto& pixel = frame2.getPixel(pixel_id);
-      auto selected_iter = findRandomEarliestAvailableDroneId(pixel, formation1, unassigned_drone_ids, earliest_available_frame_ids_db);
-      assignment2[pixel_id] = *selected_iter;
-      unassigned_drone_ids.erase(selected_iter);
+    if (cached_drone_positions != nullptr && adaptCachedHops(assignment2, *cached_drone_positions, frame2, formation1, unassigned_drone_ids, hidden_since_depths, search_depth)) {
+      formation_plan_cache.recordLookup(true);
+    } else {
+      if (formation_plan_cache.isEnabled()) formation_plan_cache.recordLookup(false);
+
+      // complete assignment2
+      std::vector<int> hopping_pixel_ids;
+      for (int pixel_id = 0; pixel_id < assignment2.size(); pixel_id++) {
+        if (assignment2[pixel_id] < 0) hopping_pixel_ids.push_back(pixel_id);
+      }
+      if (unassigned_drone_ids.count() >= HIERARCHICAL_ASSIGNMENT_MIN_DRONE_NUM) {   // too many drones for the flat assignment
+        assignHoppingPixelsHierarchically(assignment2, frame2, formation1, unassigned_drone_ids, hidden_since_depths, search_depth);
+      } else {
+        for (auto pixel_id : hopping_pixel_ids) {
+          auto pixel = frame2.getPixel(pixel_id);
+          auto drone_id = findRandomEarliestAvailableDroneId(pixel, formation1, unassigned_drone_ids, hidden_since_depths, search_depth);
+          assignment2.assign(pixel_id, drone_id);
+          unassigned_drone_ids.reset(drone_id);
+        }
+      }
+
+      if (formation_plan_cache.isEnabled()) {
+        std::vector<Pos3D> drone_positions;
+        drone_positions.reserve(hopping_pixel_ids.size());
+        for (auto pixel_id : hopping_pixel_ids) {
+          drone_positions.push_back(formation1.getDroneState(assignment2[pixel_id]).getPos());
+        }
+        formation_plan_cache.insert(fingerprint, std::move(drone_positions));
+      }
     }
   }
-  assert(std::find(assignment2.begin(), assignment2.end(), -1) == assignment2.end());  // check whether every pixel has an assignment.
+  assert(assignment2.isComplete());  // check whether every pixel has an assignment.
 
   fplan.setAssignment2(assignment2);  // set a full assignment2
 
@@ -547,105 +1010,221 @@ bool SpicompPlanner::computeFormationPlan(FormationPlan& fplan, const Frame& fra
     auto &drone_state = formation1.getDroneState(drone_id);
 
     auto pixel1 = drone_state.getPixel();
-    if (pixel2_id >= pixel_trajectory_tracking_num) {  // hopping pixel
+    if (!is_persistent_pixel[pixel2_id]) {  // hopping pixel
       pixel1 = Pixel(pixel1.getPos(), COLOR_HIDDEN);
     }
-    auto pixel2 = pixel2_set.at(pixel2_id);
+    auto pixel2 = frame2.getPixel(pixel2_id);
 
-    if (isDroneAssigned(drone_id, assignment1)) {   // this means that the drone has been used in both assignment1 and assignment2
+    if (assignment1.isDroneAssigned(drone_id)) {   // this means that the drone has been used in both assignment1 and assignment2
       computeLinearMicroFormations(fplan, drone_id, pixel1, pixel2);   // we opt for a simple solution
     } else {
       assert(drone_state.getColor() == COLOR_HIDDEN);
       assert(drone_state.getIsHidden());
 
       // at this point, all trajectory tracking pixels have an assignment.
-      computeEarliestAvailableMicroFormations(fplan, drone_id, pixel2, pixel2_id, earliest_available_frame_ids_db.at(drone_id));  // TODO: no need to pass pixel1
+      computeEarliestAvailableMicroFormations(fplan, drone_id, pixel2, pixel2_id, hidden_since_depths[drone_id]);  // TODO: no need to pass pixel1
       // computeLinearMicroFormations(fplan, drone_id, pixel1, pixel2);   // we opt for a simple solution
     }
   }
 
-  auto unassigned_drone_ids = findUnassignedDroneIds(assignment2);
-  for(int drone_id : unassigned_drone_ids) {
-    computeGoDarkMicroFormations(fplan, drone_id, formation1.getDroneState(drone_id).getPixel());
+  for(auto drone_id : assignment2) {
+    hidden_since_depths[drone_id] = -1;
   }
+  fplan.setHiddenSinceDepths(std::move(hidden_since_depths));
+
+  // both the available and the unavailable drones that are not assigned go dark, and the drones
+  // that were already dark move on to their staging targets
+  assignment2.getUnassignedDroneIds().forEachSetBit([&](int drone_id) {
+    auto& drone_state = formation1.getDroneState(drone_id);
+    if (has_staging_target.test(drone_id) && !assignment1.isDroneAssigned(drone_id)) {
+      computeStagingMicroFormations(fplan, drone_id, drone_state.getPos());
+    } else {
+      computeGoDarkMicroFormations(fplan, drone_id, drone_state.getPixel());
+    }
+  });
 
   return true;    // TODO: need to check the maximum speed
 }
 
 
-void SpicompPlanner::computeEarliestAvailableMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel2, int pixel2_id, const std::vector<int>& parent_id_list) {
+void SpicompPlanner::assignPersistentPixels(DroneAssignment& assignment2, std::vector<bool>& is_persistent_pixel, const Frame& frame1, const Frame& frame2, const DroneAssignment& assignment1) const {
+  if (!frame1.hasPixelIdentities() || !frame2.hasPixelIdentities()) {   // infer the persistent pixels from the geometry
+    assignCorrespondingPixels(assignment2, is_persistent_pixel, frame1, frame2, assignment1);
+    return;
+  }
+
+  std::unordered_map<int, int> pixel1_ids;   // pixel identity -> pixel id in frame1
+  for(int pixel1_id = pixel_trajectory_tracking_num; pixel1_id < frame1.size(); pixel1_id++) {
+    pixel1_ids[frame1.getPixelIdentity(pixel1_id)] = pixel1_id;
+  }
+
+  // a pixel that persists from frame1 to frame2 keeps its drone, unless the drone is no longer available
+  for(int pixel2_id = pixel_trajectory_tracking_num; pixel2_id < frame2.size(); pixel2_id++) {
+    auto iter = pixel1_ids.find(frame2.getPixelIdentity(pixel2_id));
+    if (iter == pixel1_ids.end()) continue;   // a new pixel
+    auto drone_id = assignment1[iter->second];
+    if (drone_id >= 0 && drone_availability.test(drone_id)) {
+      assignment2.assign(pixel2_id, drone_id);
+      is_persistent_pixel[pixel2_id] = true;
+    }
+  }
+}
+
+
+void SpicompPlanner::assignCorrespondingPixels(DroneAssignment& assignment2, std::vector<bool>& is_persistent_pixel, const Frame& frame1, const Frame& frame2, const DroneAssignment& assignment1) const {
+  static_assert(PIXEL_CORRESPONDENCE_MAX_DISTANCE <= MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME);
+  const double cell_size = PIXEL_CORRESPONDENCE_MAX_DISTANCE;
+
+  // bucket the pixels in frame2 that have no drone yet
+  auto xs2 = frame2.getXs();
+  auto ys2 = frame2.getYs();
+  auto zs2 = frame2.getZs();
+  std::unordered_map<std::int64_t, std::vector<int>> pixel2_cells;
+  for(int pixel2_id = pixel_trajectory_tracking_num; pixel2_id < frame2.size(); pixel2_id++) {
+    if (assignment2[pixel2_id] >= 0) continue;
+    pixel2_cells[getGridCellKey(xs2[pixel2_id], ys2[pixel2_id], zs2[pixel2_id], cell_size)].push_back(pixel2_id);
+  }
+
+  // match each pixel in frame1 with the nearest unmatched pixel in frame2 with the same color within the motion limit
+  for(int pixel1_id = pixel_trajectory_tracking_num; pixel1_id < frame1.size(); pixel1_id++) {
+    auto drone_id = assignment1[pixel1_id];
+    if (drone_id < 0 || !drone_availability.test(drone_id) || assignment2.isDroneAssigned(drone_id)) continue;
+
+    auto pos1 = frame1.getPos(pixel1_id);
+    auto& color1 = frame1.getColor(pixel1_id);
+    auto cx = getGridCellCoord(pos1.x, cell_size);
+    auto cy = getGridCellCoord(pos1.y, cell_size);
+    auto cz = getGridCellCoord(pos1.z, cell_size);
+    MinKeeper<int, double> nearest_pixel2_id(-1, PIXEL_CORRESPONDENCE_MAX_DISTANCE + EPSILON);
+    for(auto dx = -1; dx <= 1; dx++) {
+      for(auto dy = -1; dy <= 1; dy++) {
+        for(auto dz = -1; dz <= 1; dz++) {
+          auto iter = pixel2_cells.find(getGridCellKey(cx + dx, cy + dy, cz + dz));
+          if (iter == pixel2_cells.end()) continue;
+          for(auto pixel2_id : iter->second) {
+            if (assignment2[pixel2_id] < 0 && frame2.getColor(pixel2_id) == color1) {
+              nearest_pixel2_id.insert(pixel2_id, pos1.distance(frame2.getPos(pixel2_id)));
+            }
+          }
+        }
+      }
+    }
+
+    auto pixel2_id = nearest_pixel2_id.getMinData();
+    if (pixel2_id >= 0) {
+      assignment2.assign(pixel2_id, drone_id);
+      is_persistent_pixel[pixel2_id] = true;
+    }
+  }
+}
+
+
+std::vector<std::int16_t> SpicompPlanner::computeHiddenSinceDepths(const DroneAssignment& partial_assignment2, int search_depth) const {
+  assert(search_depth + 1 == static_cast<int>(search_frame_ids.size()));
+  std::vector<std::int16_t> hidden_since_depths(drone_num, static_cast<std::int16_t>(search_depth));
+  if (search_depth > 0) {  // inherit from the parent formation plan
+    auto& parent_fplan = cf_plan.getFormationPlan(search_frame_ids[search_depth-1], search_frame_ids[search_depth]);
+    auto& parent_hidden_since_depths = parent_fplan.getHiddenSinceDepths();
+    assert(static_cast<int>(parent_hidden_since_depths.size()) == drone_num);
+    for(int drone_id=0; drone_id<drone_num; drone_id++) {
+      if (parent_hidden_since_depths[drone_id] >= 0) {
+        hidden_since_depths[drone_id] = parent_hidden_since_depths[drone_id];
+      }
+    }
+  }
+  for(auto drone_id : partial_assignment2) {
+    if (drone_id >= 0) hidden_since_depths[drone_id] = -1;
+  }
+  return hidden_since_depths;
+}
+
+
+void SpicompPlanner::computeEarliestAvailableMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel2, int pixel2_id, int hidden_since_depth) {
   auto& assignment2 = fplan.getAssignment2();
 
-  assignment2[pixel2_id] = -1;  // MUST temporarily remove the assignment of drone_id in assignment2;
-  // auto parent_id_list = findEarliestAvailableFrameId(fplan, drone_id);
+  assignment2.unassign(pixel2_id);  // MUST temporarily remove the assignment of drone_id in assignment2;
+
+  // the frame ids from the earliest available frame to frame2, which is not on the search path yet;
+  // a view of the search path rather than a copy, since this runs for every hopping pixel
+  assert(hidden_since_depth >= 0 && hidden_since_depth < static_cast<int>(search_frame_ids.size()));
+  std::span<const int> path_frame_ids(search_frame_ids.begin() + hidden_since_depth, search_frame_ids.end());
+  auto getPathFrameId = [&](int i) { return (i < static_cast<int>(path_frame_ids.size())) ? path_frame_ids[i] : fplan.getFrame2Id(); };
 
-  // __vv__(parent_id_list);
-  assert(parent_id_list.size() >= 2);
-  assert(parent_id_list[parent_id_list.size()-2] == fplan.getFrame1Id());  // since drone_id must not be assigned in assignment1
+  assert(path_frame_ids.back() == fplan.getFrame1Id());  // since drone_id must not be assigned in assignment1
 
-  int flight_time_step = parent_id_list.size() - 1;
+  int flight_time_step = static_cast<int>(path_frame_ids.size());
 
 
-//  // check whether the parent_id_list is correct
+//  // check whether the path is correct
 //  for(int i=0; i<flight_time_step-1; i++) {
-//    auto& tmp_fplan = cf_plan.getFormationPlan(parent_id_list[i], parent_id_list[i+1]);
-//    assert(!isDroneAssigned(drone_id, tmp_fplan.getAssignment2()));
+//    auto& tmp_fplan = cf_plan.getFormationPlan(getPathFrameId(i), getPathFrameId(i+1));
+//    assert(!tmp_fplan.getAssignment2().isDroneAssigned(drone_id));
 //  }
 
-  auto& first_fplan = cf_plan.getFormationPlan(parent_id_list[0], parent_id_list[1]);  // the size of parent_id_list is at least 2
-  auto& first_pos = first_fplan.getFormation1().getDroneState(drone_id).getPos();
+  auto& first_fplan = cf_plan.getFormationPlan(getPathFrameId(0), getPathFrameId(1));  // the path has at least two frames
+  auto first_pos = first_fplan.getFormation1().getDroneState(drone_id).getPos();
 
   auto dist = first_pos.distance(pixel2.getPos());
   auto max_dist = MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME * flight_time_step;
   // __vv__(dist, max_dist);
   assert(dist <= max_dist);  // TODO: need to reduce MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME
+  hop_statistics.add(dist / flight_time_step);
 
   const double MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME = MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME / static_cast<double>(micro_frame_num);
 
+  // the speed limit holds between the stored positions, which are rounded to GeometryPrecision, so a
+  // step toward pixel2 is shortened by the rounding error and the flight continues from the stored position
+  const double max_step_distance = MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME - MAX_STORED_POSITION_ERROR;
+  const auto pos2 = DroneState(pixel2).getPos();
+
   Pos3D current_pos = first_pos;
   for(int i=0; i<flight_time_step; i++) {
-    auto& tmp_fplan = cf_plan.getFormationPlan(parent_id_list[i], parent_id_list[i+1]);
+    auto& tmp_fplan = cf_plan.getFormationPlan(getPathFrameId(i), getPathFrameId(i+1));
     if (i > 0) {
-      tmp_fplan.setFormation1(cf_plan.getFormationPlan(parent_id_list[i-1], parent_id_list[i]).getFormation2());
+      tmp_fplan.setFormation1(cf_plan.getFormationPlan(getPathFrameId(i-1), getPathFrameId(i)).getFormation2());
     }
     auto& tmp_assignment2 = tmp_fplan.getAssignment2();
-    assert(!isDroneAssigned(drone_id, tmp_assignment2));
+    assert(!tmp_assignment2.isDroneAssigned(drone_id));
     assert(tmp_fplan.getFormation2().getDroneState(drone_id).getIsHidden());
 
     for (int micro_frame_id = 0; micro_frame_id < micro_frame_num; micro_frame_id++) {
-      auto &next_drone_state = tmp_fplan.getMicroFormation(micro_frame_id).getDroneState(drone_id);
-
-      if (current_pos != pixel2.getPos()) {
-        auto dist = current_pos.distance(pixel2.getPos());
+      if (current_pos != pos2) {
+        auto dist = current_pos.distance(pos2);
         assert(!isZero(dist));
         if (dist > MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME) {
-          // just move a distance of MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME
-          auto dx = (pixel2.x - current_pos.x) *  MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME / dist;
-          auto dy = (pixel2.y - current_pos.y) *  MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME / dist;
-          auto dz = (pixel2.z - current_pos.z) *  MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME / dist;
+          // just move a distance of max_step_distance
+          auto dx = (pos2.x - current_pos.x) *  max_step_distance / dist;
+          auto dy = (pos2.y - current_pos.y) *  max_step_distance / dist;
+          auto dz = (pos2.z - current_pos.z) *  max_step_distance / dist;
           current_pos.translate(dx, dy, dz);
+          current_pos = DroneState(current_pos.x, current_pos.y, current_pos.z).getPos();
         } else {  // else can arrive at pixel2 in one microframe
-          current_pos = pixel2.getPos();
+          current_pos = pos2;
         }
       }
-      next_drone_state.setPos(current_pos);
       auto color = (i == flight_time_step-1 && micro_frame_id == micro_frame_num - 1) ? (pixel2.getColor()) : COLOR_HIDDEN;
       // auto color = (i == flight_time_step-1 && micro_frame_id == micro_frame_num - 1) ? COLOR_BLUE : COLOR_HIDDEN;
-      next_drone_state.setColor(color);
+      tmp_fplan.getMicroFormation(micro_frame_id).setDroneState(drone_id, current_pos, color);
     }
     if (i == flight_time_step-2) {
-      assert(current_pos == pixel2.getPos());
+      assert(current_pos == pos2);
     }
   }
 
-  assignment2[pixel2_id] = drone_id;  // MUST restore the assignment of drone_id in assignment2;
+  assignment2.assign(pixel2_id, drone_id);  // MUST restore the assignment of drone_id in assignment2;
 }
 
 
 void SpicompPlanner::computeLinearMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1, const Pixel& pixel2) {
-  for (int micro_frame_id = 0; micro_frame_id < micro_frame_num; micro_frame_id++) {
-    auto &next_drone_state = fplan.getMicroFormation(micro_frame_id).getDroneState(drone_id);
+  switch(micro_frame_num) {   // dispatch the common micro frame numbers to their unrolled versions
+    case 4:  computeLinearMicroFormations<4>(fplan, drone_id, pixel1, pixel2);  return;
+    case 5:  computeLinearMicroFormations<5>(fplan, drone_id, pixel1, pixel2);  return;
+    case 8:  computeLinearMicroFormations<8>(fplan, drone_id, pixel1, pixel2);  return;
+    case 10: computeLinearMicroFormations<10>(fplan, drone_id, pixel1, pixel2); return;
+    default: break;
+  }
 
+  for (int micro_frame_id = 0; micro_frame_id < micro_frame_num; micro_frame_id++) {
     // micro_frame_id + 1 ensures that formation1 will not be duplicated.
     auto x = (micro_frame_id == micro_frame_num - 1) ? (pixel2.x) : (pixel1.x + (pixel2.x - pixel1.x) *
                                                                                 (static_cast<double>(micro_frame_id + 1) /
@@ -658,90 +1237,286 @@ void SpicompPlanner::computeLinearMicroFormations(FormationPlan& fplan, int dron
                                                                                  static_cast<double>(micro_frame_num)));
     auto color = (micro_frame_id == micro_frame_num - 1) ? (pixel2.getColor()) : (pixel1.getColor());
 
-    next_drone_state.setPos(x, y, z);
-    next_drone_state.setColor(color);
+    fplan.getMicroFormation(micro_frame_id).setDroneState(drone_id, Pos3D(x, y, z), color);
   }
 }
 
 
-void SpicompPlanner::computeGoDarkMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1) {
-  for (int micro_frame_id = 0; micro_frame_id < micro_frame_num; micro_frame_id++) {
-    auto &next_drone_state = fplan.getMicroFormation(micro_frame_id).getDroneState(drone_id);
-    // auto color = (micro_frame_id == 0) ? (pixel1.getColor()) : COLOR_HIDDEN;
-    auto color = COLOR_HIDDEN;
-    next_drone_state.setPos(pixel1.getPos());
-    next_drone_state.setColor(color);
-  }
+template<int MICRO_FRAME_NUM>
+void SpicompPlanner::computeLinearMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1, const Pixel& pixel2) {
+  assert(micro_frame_num == MICRO_FRAME_NUM);
+  constexpr auto& weights = MICRO_FRAME_WEIGHTS<MICRO_FRAME_NUM>;
+  auto dx = pixel2.x - pixel1.x;
+  auto dy = pixel2.y - pixel1.y;
+  auto dz = pixel2.z - pixel1.z;
+  auto color1 = pixel1.getColor();
+
+  // the same positions as the loop above, but with constant weights and without the loop
+  [&]<int... MICRO_FRAME_IDS>(std::integer_sequence<int, MICRO_FRAME_IDS...>) {
+    (fplan.getMicroFormation(MICRO_FRAME_IDS).setDroneState(drone_id, Pos3D(pixel1.x + dx * weights[MICRO_FRAME_IDS],
+                                                                            pixel1.y + dy * weights[MICRO_FRAME_IDS],
+                                                                            pixel1.z + dz * weights[MICRO_FRAME_IDS]), color1), ...);
+  }(std::make_integer_sequence<int, MICRO_FRAME_NUM - 1>{});
+
+  fplan.getMicroFormation(MICRO_FRAME_NUM - 1).setDroneState(drone_id, pixel2.getPos(), pixel2.getColor());
 }
 
 
-std::list<int> SpicompPlanner::findUnassignedDroneIds(const std::vector<int>& assignment2) const {
-  std::vector<bool> assigned_drone_id(drone_num, false);
-  for(int pixel_id=0; pixel_id<assignment2.size(); pixel_id++) {
-    auto drone_id = assignment2[pixel_id];
-    if (drone_id >= 0) {
-      assigned_drone_id[drone_id] = true;
-      assert(drone_id < drone_num);
-    }
+void SpicompPlanner::computeStagingMicroFormations(FormationPlan& fplan, int drone_id, const Pos3D& pos1) {
+  static_assert(STAGING_DISTANCE_PER_FRAME < MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME);
+  auto& target = staging_targets[drone_id];
+  auto dist = pos1.distance(target);
+  if (dist <= STAGING_DISTANCE_PER_FRAME) {   // arrived, or arriving in this frame
+    computeLinearMicroFormations(fplan, drone_id, Pixel(pos1, COLOR_HIDDEN), Pixel(target, COLOR_HIDDEN));
+    return;
   }
-  std::list<int> remaining_drone_ids;
-  for(int drone_id=0; drone_id<drone_num; drone_id++) {
-    if (!assigned_drone_id[drone_id])  {
-      remaining_drone_ids.push_back(drone_id);
-    }
+  auto step = STAGING_DISTANCE_PER_FRAME / dist;
+  Pos3D pos2(pos1.x + (target.x - pos1.x) * step, pos1.y + (target.y - pos1.y) * step, pos1.z + (target.z - pos1.z) * step);
+  computeLinearMicroFormations(fplan, drone_id, Pixel(pos1, COLOR_HIDDEN), Pixel(pos2, COLOR_HIDDEN));
+}
+
+
+void SpicompPlanner::computeGoDarkMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1) {
+  for (int micro_frame_id = 0; micro_frame_id < micro_frame_num; micro_frame_id++) {
+    // auto color = (micro_frame_id == 0) ? (pixel1.getColor()) : COLOR_HIDDEN;
+    auto color = COLOR_HIDDEN;
+    fplan.getMicroFormation(micro_frame_id).setDroneState(drone_id, pixel1.getPos(), color);   // usually unchanged, so the chunk stays shared
   }
-  return remaining_drone_ids;
 }
 
 
-std::list<int>::const_iterator SpicompPlanner::findRandomNearbyDroneId(const Pos3D& pixel_pos, const Formation& formation1, const std::list<int>& unassigned_drone_ids) {
+int SpicompPlanner::findRandomNearbyDroneId(const Pos3D& pixel_pos, const Formation& formation1, const DynamicBitset& unassigned_drone_ids) {
+  std::vector<int> drone_ids;
   std::vector<double> weights;
-  for(auto drone_id : unassigned_drone_ids) {
+  unassigned_drone_ids.forEachSetBit([&](int drone_id) {
     auto pos = formation1.getDroneState(drone_id).getPixel().getPos();
     auto distance = pixel_pos.distance(pos);
+    drone_ids.push_back(drone_id);
     weights.push_back(1.0 / (distance + EPSILON));
-  }
-  auto i = SharedRand::getRandWeightedIndex(weights);
-  auto iter = unassigned_drone_ids.cbegin();
-  std::advance(iter, i);
-  return iter;
+  });
+  return drone_ids[SharedRand::getRandWeightedIndex(weights)];
 }
 
 
-std::list<int>::const_iterator SpicompPlanner::findRandomEarliestAvailableDroneId(const Pos3D& pixel_pos, const Formation& formation1, const std::list<int>& unassigned_drone_ids, const std::unordered_map<int, std::vector<int>>& earliest_available_frame_ids_db) {
+int SpicompPlanner::findRandomEarliestAvailableDroneId(const Pos3D& pixel_pos, const Formation& formation1, const DynamicBitset& unassigned_drone_ids,
+                                                       const std::vector<std::int16_t>& hidden_since_depths, int search_depth) {
+  std::vector<int> drone_ids;
   std::vector<double> weights;
-  for(auto drone_id : unassigned_drone_ids) {
-    auto pos = formation1.getDroneState(drone_id).getPixel().getPos();
-    int flight_time_step = earliest_available_frame_ids_db.at(drone_id).size() - 1;
-    auto avg_distance = pixel_pos.distance(pos) / flight_time_step;
-    weights.push_back(1.0 / (avg_distance + EPSILON));
-  }
-  auto i = SharedRand::getRandWeightedIndex(weights);
-  auto iter = unassigned_drone_ids.cbegin();
-  std::advance(iter, i);
-  return iter;
+  unassigned_drone_ids.forEachSetBit([&](int drone_id) {
+    drone_ids.push_back(drone_id);
+    weights.push_back(getEarliestAvailableWeight(pixel_pos, formation1, drone_id, hidden_since_depths, search_depth));
+  });
+  return drone_ids[SharedRand::getRandWeightedIndex(weights)];
 }
 
 
-void SpicompPlanner::findEarliestAvailableFrameId(std::vector<int>& parent_frame_id_list, const FormationPlan& fplan, int drone_id) const {
-  auto& assignment2 = fplan.getAssignment2();
-  if (isDroneAssigned(drone_id, assignment2)) {
-    return;  // drone_id not available.
+bool SpicompPlanner::adaptCachedHops(DroneAssignment& assignment2, const std::vector<Pos3D>& cached_drone_positions, const Frame& frame2,
+                                     const Formation& formation1, const DynamicBitset& unassigned_drone_ids,
+                                     const std::vector<std::int16_t>& hidden_since_depths, int search_depth) {
+  std::vector<int> hopping_pixel_ids;
+  for(int pixel_id = 0; pixel_id < assignment2.size(); pixel_id++) {
+    if (assignment2[pixel_id] < 0) hopping_pixel_ids.push_back(pixel_id);
   }
-  auto frame1_id = fplan.getFrame1Id();
-  parent_frame_id_list.push_back(frame1_id);
+  if (hopping_pixel_ids.size() != cached_drone_positions.size()) return false;   // a collision of fingerprints
 
-  if (frame_tree.hasParentFrameId(frame1_id)) {
-    auto parent_id = frame_tree.getParentFrameId(frame1_id);
-    assert(cf_plan.isFormationPlanExist(parent_id, frame1_id));   // due to DFS, parent formation plan must exist
-    auto& parent_fplan = cf_plan.getFormationPlan(parent_id, frame1_id);
-    return findEarliestAvailableFrameId(parent_frame_id_list, parent_fplan, drone_id);
-  } else {  // no parent frame -> no parent formation plan
-    assert(frame1_id == frame_tree.getRootFrameId());
+  // the candidate drones in the cells of the cached drones and of the new pixels, which are taken out as they are chosen
+  std::unordered_map<std::size_t, std::vector<int>> cell_drone_ids;
+  for(std::size_t i = 0; i < hopping_pixel_ids.size(); i++) {
+    cell_drone_ids.try_emplace(FormationPlanCache::makeCellKey(cached_drone_positions[i]));
+    cell_drone_ids.try_emplace(FormationPlanCache::makeCellKey(frame2.getPos(hopping_pixel_ids[i])));
   }
+  unassigned_drone_ids.forEachSetBit([&](int drone_id) {
+    auto iter = cell_drone_ids.find(FormationPlanCache::makeCellKey(formation1.getDroneState(drone_id).getPos()));
+    if (iter != cell_drone_ids.end()) iter->second.push_back(drone_id);
+  });
+  auto findNearest = [&](std::vector<int>& drone_ids, const Pos3D& pos) {
+    return std::min_element(drone_ids.begin(), drone_ids.end(), [&](int drone_id1, int drone_id2) {
+      return formation1.getDroneState(drone_id1).getPos().distance(pos) < formation1.getDroneState(drone_id2).getPos().distance(pos);
+    });
+  };
+  auto findEarliestAvailable = [&](std::vector<int>& drone_ids, const Pos3D& pixel_pos) {
+    return std::max_element(drone_ids.begin(), drone_ids.end(), [&](int drone_id1, int drone_id2) {
+      return getEarliestAvailableWeight(pixel_pos, formation1, drone_id1, hidden_since_depths, search_depth) <
+             getEarliestAvailableWeight(pixel_pos, formation1, drone_id2, hidden_since_depths, search_depth);
+    });
+  };
+
+  // a new pixel takes the candidate nearest to its cached drone, unless a candidate in its own cell
+  // is available earlier, e.g., a drone that has been staged there since the entry was cached
+  std::vector<int> drone_ids;
+  drone_ids.reserve(hopping_pixel_ids.size());
+  for(std::size_t i = 0; i < hopping_pixel_ids.size(); i++) {
+    auto pixel_pos = frame2.getPos(hopping_pixel_ids[i]);
+    auto& cached_cell_drone_ids = cell_drone_ids[FormationPlanCache::makeCellKey(cached_drone_positions[i])];
+    auto& pixel_cell_drone_ids = cell_drone_ids[FormationPlanCache::makeCellKey(pixel_pos)];
+    auto* chosen_drone_ids = &cached_cell_drone_ids;
+    auto iter = findNearest(cached_cell_drone_ids, cached_drone_positions[i]);
+    if (!pixel_cell_drone_ids.empty()) {
+      auto pixel_cell_iter = findEarliestAvailable(pixel_cell_drone_ids, pixel_pos);
+      if (iter == cached_cell_drone_ids.end() ||
+          getEarliestAvailableWeight(pixel_pos, formation1, *pixel_cell_iter, hidden_since_depths, search_depth) >
+          getEarliestAvailableWeight(pixel_pos, formation1, *iter, hidden_since_depths, search_depth)) {
+        chosen_drone_ids = &pixel_cell_drone_ids;
+        iter = pixel_cell_iter;
+      }
+    }
+    if (iter == chosen_drone_ids->end()) return false;
+    drone_ids.push_back(*iter);
+    *iter = chosen_drone_ids->back();
+    chosen_drone_ids->pop_back();
+  }
+  for(std::size_t i = 0; i < hopping_pixel_ids.size(); i++) {
+    assignment2.assign(hopping_pixel_ids[i], drone_ids[i]);
+  }
+  return true;
 }
 
 
+void SpicompPlanner::assignHoppingPixelsHierarchically(DroneAssignment& assignment2, const Frame& frame2, const Formation& formation1, const DynamicBitset& unassigned_drone_ids,
+                                                       const std::vector<std::int16_t>& hidden_since_depths, int search_depth) {
+  std::vector<int> hopping_pixel_ids;   // the trajectory tracking pixels are assigned already, unless uncovered
+  for(int pixel_id = 0; pixel_id < assignment2.size(); pixel_id++) {
+    if (assignment2[pixel_id] < 0) hopping_pixel_ids.push_back(pixel_id);
+  }
+  std::vector<int> drone_ids;
+  unassigned_drone_ids.forEachSetBit([&](int drone_id) { drone_ids.push_back(drone_id); });
+  assert(drone_ids.size() >= hopping_pixel_ids.size());
+
+  // --- build a uniform grid over the hopping pixels and the candidate drones ---
+
+  double lower[3] = {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+  double upper[3] = {std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+  auto extendBounds = [&](const Pos3D& pos) {
+    double v[3] = {pos.x, pos.y, pos.z};
+    for(int k = 0; k < 3; k++) {
+      lower[k] = std::min(lower[k], v[k]);
+      upper[k] = std::max(upper[k], v[k]);
+    }
+  };
+  for(auto pixel_id : hopping_pixel_ids) {
+    extendBounds(frame2.getPos(pixel_id));
+  }
+  for(auto drone_id : drone_ids) {
+    extendBounds(formation1.getDroneState(drone_id).getPos());
+  }
+
+  // the cell size is chosen such that a cell holds HIERARCHICAL_ASSIGNMENT_CLUSTER_SIZE drones on average
+  int target_cell_num = std::max(1, static_cast<int>(drone_ids.size()) / HIERARCHICAL_ASSIGNMENT_CLUSTER_SIZE);
+  double volume = 1.0;
+  int dim_num = 0;
+  for(int k = 0; k < 3; k++) {
+    if (isNotZero(upper[k] - lower[k])) {
+      volume *= upper[k] - lower[k];
+      dim_num++;
+    }
+  }
+  double cell_size = (dim_num > 0) ? std::pow(volume / target_cell_num, 1.0 / dim_num) : 1.0;
+  int grid_size[3];
+  for(int k = 0; k < 3; k++) {
+    grid_size[k] = std::max(1, int_ceil((upper[k] - lower[k]) / cell_size));
+  }
+  int cell_num = grid_size[0] * grid_size[1] * grid_size[2];
+
+  auto getCellCoord = [&](const Pos3D& pos, int k) {
+    double v = (k == 0) ? pos.x : ((k == 1) ? pos.y : pos.z);
+    return std::clamp(static_cast<int>((v - lower[k]) / cell_size), 0, grid_size[k] - 1);
+  };
+  auto getCellId = [&](int cx, int cy, int cz) { return (cx * grid_size[1] + cy) * grid_size[2] + cz; };
+  auto getCellIdOf = [&](const Pos3D& pos) { return getCellId(getCellCoord(pos, 0), getCellCoord(pos, 1), getCellCoord(pos, 2)); };
+
+  std::vector<std::vector<int>> pixel_cells(cell_num);
+  std::vector<std::vector<int>> drone_cells(cell_num);
+  for(auto pixel_id : hopping_pixel_ids) {
+    pixel_cells[getCellIdOf(frame2.getPos(pixel_id))].push_back(pixel_id);
+  }
+  for(auto drone_id : drone_ids) {
+    drone_cells[getCellIdOf(formation1.getDroneState(drone_id).getPos())].push_back(drone_id);
+  }
+
+  // --- match each pixel cell with the nearest drone cells, up to the number of pixels in the cell ---
+
+  std::vector<int> group_cell_ids;                     // the cells that have hopping pixels
+  std::vector<std::vector<int>> group_drone_ids(cell_num);   // the drones matched with the pixels in a cell
+  int max_radius = std::max({grid_size[0], grid_size[1], grid_size[2]});
+
+  for(int cell_id = 0; cell_id < cell_num; cell_id++) {
+    auto& pixel_ids = pixel_cells[cell_id];
+    if (pixel_ids.empty()) continue;
+    group_cell_ids.push_back(cell_id);
+
+    Pos3D center;
+    for(auto pixel_id : pixel_ids) {
+      center.translate(frame2.getPos(pixel_id));
+    }
+    center = Pos3D(center.x / pixel_ids.size(), center.y / pixel_ids.size(), center.z / pixel_ids.size());
+    int c[3] = {getCellCoord(center, 0), getCellCoord(center, 1), getCellCoord(center, 2)};
+
+    int demand = pixel_ids.size();
+    auto takeDrones = [&](int cx, int cy, int cz) {
+      if (demand == 0 || cx < 0 || cx >= grid_size[0] || cy < 0 || cy >= grid_size[1] || cz < 0 || cz >= grid_size[2]) return;
+      auto& drone_cell = drone_cells[getCellId(cx, cy, cz)];
+      int k = std::min(demand, static_cast<int>(drone_cell.size()));
+      if (k == 0) return;
+      if (static_cast<std::size_t>(k) < drone_cell.size()) {   // move the k drones nearest to the center to the end of the cell
+        std::nth_element(drone_cell.begin(), drone_cell.end() - k, drone_cell.end(), [&](int drone_id1, int drone_id2) {
+          return center.distance(formation1.getDroneState(drone_id1).getPos()) > center.distance(formation1.getDroneState(drone_id2).getPos());
+        });
+      }
+      group_drone_ids[cell_id].insert(group_drone_ids[cell_id].end(), drone_cell.end() - k, drone_cell.end());
+      drone_cell.resize(drone_cell.size() - k);
+      demand -= k;
+    };
+
+    // visit the cells on the surface of cubes of increasing radius around the center
+    for(int r = 0; demand > 0; r++) {
+      assert(r <= max_radius);
+      for(int dx = -r; dx <= r; dx++) {
+        for(int dy = -r; dy <= r; dy++) {
+          if (std::abs(dx) == r || std::abs(dy) == r) {
+            for(int dz = -r; dz <= r; dz++) takeDrones(c[0] + dx, c[1] + dy, c[2] + dz);
+          } else {
+            takeDrones(c[0] + dx, c[1] + dy, c[2] - r);
+            if (r > 0) takeDrones(c[0] + dx, c[1] + dy, c[2] + r);
+          }
+        }
+      }
+    }
+  }
+
+  // --- assign the drones to the pixels within each matched group in parallel ---
+
+  std::vector<std::mt19937::result_type> seeds;   // drawn sequentially so that a run is reproducible
+  for(std::size_t i = 0; i < group_cell_ids.size(); i++) {
+    seeds.push_back(SharedRand::getRng()());
+  }
+
+  std::vector<std::vector<int>> selected_drone_ids(group_cell_ids.size());
+  parallel_for(group_cell_ids.size(), [&](int group_id) {
+    std::mt19937 rng(seeds[group_id]);
+    auto cell_id = group_cell_ids[group_id];
+    auto& candidate_drone_ids = group_drone_ids[cell_id];
+    std::vector<double> weights;
+    for(auto pixel_id : pixel_cells[cell_id]) {
+      weights.clear();
+      for(auto drone_id : candidate_drone_ids) {
+        weights.push_back(getEarliestAvailableWeight(frame2.getPixel(pixel_id), formation1, drone_id, hidden_since_depths, search_depth));
+      }
+      std::discrete_distribution<int> rand_index(weights.begin(), weights.end());
+      auto i = rand_index(rng);
+      selected_drone_ids[group_id].push_back(candidate_drone_ids[i]);
+      candidate_drone_ids[i] = candidate_drone_ids.back();
+      candidate_drone_ids.pop_back();
+    }
+  });
+
+  for(std::size_t group_id = 0; group_id < group_cell_ids.size(); group_id++) {
+    auto& pixel_ids = pixel_cells[group_cell_ids[group_id]];
+    for(std::size_t i = 0; i < pixel_ids.size(); i++) {
+      assignment2.assign(pixel_ids[i], selected_drone_ids[group_id][i]);
+    }
+  }
+}
+
 
 // -------------------------------------------------------------------------------------------
 //   The SPICOMP Simulator
@@ -752,26 +1527,22 @@ void SpicompSimulator::reset() {
   micro_frame_step_count = 0;
 
   game_controller.reset();
-  frame_buffer.reset();
+  game_controller.growInitFrameTree();
 
-  auto init_frame_tree = game_controller.getInitFrameTree();
-  assert(!init_frame_tree.empty());
-  frame_buffer.setFrameTree(init_frame_tree);
-
-  auto& first_frame = frame_buffer.getFrameTree().getRootFrame();
+  auto& first_frame = game_controller.getFrameTree().getRootFrame();
 
   assert(drone_num >= first_frame.size());
 
   // --- initialize the first formation and the first formation plan ---
 
   Formation current_formation;
-  DroneAssignment current_assignment;
+  DroneAssignment current_assignment(first_frame.size(), drone_num);
 
   // put drones at the initial frame
   int j=0;
-  for(auto& pixel: first_frame.getPixels()) {
-    current_formation.addDroneState(pixel);
-    current_assignment.push_back(j);
+  for(int pixel_id = 0; pixel_id < first_frame.size(); pixel_id++) {
+    current_formation.addDroneState(first_frame.getPixel(pixel_id));
+    current_assignment.assign(j, j);
     j++;
   }
 
@@ -783,55 +1554,86 @@ void SpicompSimulator::reset() {
   }
 
   // initialize the current formation plan
+  is_next_plan_ready = false;
+  next_cf_plan.clear();
   cf_plan.clear();
-  SpicompPlanner planner(drone_num, micro_frame_num, frame_buffer.getFrameTree(), current_formation, current_assignment, cf_plan, game_controller.getPixelTrajectoryTrackingNum());
-  cf_plan = planner.getContingencyFormationPlan();
+  formation_plan_cache.clear();
+  staging_demand_cache.clear();
+  drone_availability = DynamicBitset(drone_num, true);
+  SpicompPlanner planner(drone_num, micro_frame_num, game_controller.getFrameTree(), current_formation, current_assignment, cf_plan, formation_plan_cache, drone_availability,
+                         game_controller.getPixelTrajectoryTrackingNum(), is_staging_enabled, &staging_demand_cache);
+  cf_plan = planner.releaseContingencyFormationPlan();
+  hop_statistics = planner.getHopStatistics();
 }
 
-Frame SpicompSimulator::getCurrentMicroFrame() const {   // this function runs before nextStep()
+const Formation& SpicompSimulator::getCurrentMicroFormation() const {   // this function runs before nextStep()
   auto& fplan = getCurrentFormationPlan();
-  return fplan.getMicroFormation(micro_frame_step_count).makeFrame();
+  return fplan.getMicroFormation(micro_frame_step_count);
 }
 
 
 void SpicompSimulator::nextStep() {
   // __vv__(sim_step_count);
   if (micro_frame_step_count == micro_frame_num-1) {
-    auto& fplan = getCurrentFormationPlan();
-    auto current_formation = getCurrentFormationPlan().getFormation2();
-    auto current_assignment = fplan.getAssignment2();
-
-    game_controller.removeFirstGameState();
-    frame_buffer.removeFirstFrame();
+    if (is_next_plan_ready) {   // just commit the speculative plan
+      game_controller.removeFirstFrame();   // the next frontier has been expanded by speculate()
+      std::swap(cf_plan, next_cf_plan);
+      hop_statistics += next_hop_statistics;
+      is_next_plan_ready = false;
+    } else {
+      // cf_plan stays intact until the new plan replaces it, so the planner can read from it directly
+      auto& fplan = getCurrentFormationPlan();
+      auto& current_formation = fplan.getFormation2();
+      auto& current_assignment = fplan.getAssignment2();
 
-     // add new frames to the frame buffer
-    auto frame_tree_list = game_controller.getNewFrameTrees();
+      // remove the first frame and add the new frames
+      game_controller.removeFirstFrame();
 
-    if (!frame_tree_list.empty()) {
-      // add new frames to the frame buffer
-      for(auto& frame_tree: frame_tree_list) {
-        frame_buffer.attachFrameTree(frame_tree);
-      }
       // update the current formation plan
-      SpicompPlanner planner(drone_num, micro_frame_num, frame_buffer.getFrameTree(), current_formation, current_assignment, cf_plan, game_controller.getPixelTrajectoryTrackingNum());
-      cf_plan = planner.getContingencyFormationPlan();
+      SpicompPlanner planner(drone_num, micro_frame_num, game_controller.getFrameTree(), current_formation, current_assignment, cf_plan, formation_plan_cache, drone_availability,
+                             game_controller.getPixelTrajectoryTrackingNum(), is_staging_enabled, &staging_demand_cache);
+      cf_plan = planner.releaseContingencyFormationPlan();
+      hop_statistics += planner.getHopStatistics();
     }
 
+    cf_plan.collectGarbage(game_controller.getFrameTree());
+    staging_demand_cache.collectGarbage(game_controller.getFrameTree());
     micro_frame_step_count=0;
   } else {
+    // the branches discarded at the frame boundary are reclaimed in the first idle tick
+    game_controller.reclaimDiscardedFrames();
+    speculate();
     micro_frame_step_count++;
   }
 
   game_controller.nextStep();
-  frame_buffer.nextStep();
   sim_step_count++;
+}
+
 
-  assert(game_controller.size() == frame_buffer.size());
+void SpicompSimulator::speculate() {
+  if (is_next_plan_ready) return;
+
+  // Expand the next frontier in the first idle tick and plan in the next one, if any. The frontier
+  // hangs below the terminal frames of the next root frame only, so the next plan covers the
+  // subtree of the next root frame, and the frame boundary removes the frames above it in place.
+  if (!game_controller.isNextFrontierPrepared()) {
+    game_controller.prepareNextFrontier();
+    if (micro_frame_step_count < micro_frame_num - 2) return;
+  }
+
+  // the next plan starts from the end of the current formation plan
+  auto& fplan = getCurrentFormationPlan();
+  SpicompPlanner planner(drone_num, micro_frame_num, game_controller.getFrameTree(), game_controller.getNextRootFrameId(), fplan.getFormation2(), fplan.getAssignment2(),
+                         cf_plan, formation_plan_cache, drone_availability, game_controller.getPixelTrajectoryTrackingNum(), is_staging_enabled, &staging_demand_cache);
+  next_cf_plan = planner.releaseContingencyFormationPlan();
+  next_hop_statistics = planner.getHopStatistics();
+  is_next_plan_ready = true;
 }
 
 
 const FormationPlan& SpicompSimulator::getCurrentFormationPlan() const {
-  auto& frame_tree = frame_buffer.getFrameTree();
+  auto& frame_tree = game_controller.getFrameTree();
   // frame_tree.print();
   assert(!frame_tree.empty());
   auto frame_id = frame_tree.getRootFrameId();
@@ -842,3 +1644,231 @@ const FormationPlan& SpicompSimulator::getCurrentFormationPlan() const {
   return cf_plan.getFormationPlan(frame_id, child_frame_id);
 }
 
+
+bool SpicompSimulator::disableDrone(int drone_id) {
+  assert(0 <= drone_id && drone_id < drone_num);
+  if (!drone_availability.test(drone_id)) return true;  // already disabled
+  drone_availability.reset(drone_id);
+  is_next_plan_ready = false;   // the speculative plan may use the failed drone
+
+  // the failed drone stays where it is in the micro frame that has been shown last
+  auto& fplan = getCurrentFormationPlan();
+  auto& shown_formation = (micro_frame_step_count == 0) ? fplan.getFormation1() : fplan.getMicroFormation(micro_frame_step_count - 1);
+  auto failed_drone_pos = shown_formation.getDroneState(drone_id).getPos();
+
+  int root_frame_id = game_controller.getFrameTree().getRootFrameId();
+  bool is_repaired = repairFormationPlans(root_frame_id, drone_id);
+  pinFailedDrone(root_frame_id, drone_id, failed_drone_pos);
+  cf_plan.collectGarbage(game_controller.getFrameTree());   // the repairs copy shared chunks
+  return is_repaired;
+}
+
+
+bool SpicompSimulator::repairFormationPlans(int subtree_root_frame_id, int failed_drone_id) {
+  auto& frame_tree = game_controller.getFrameTree();
+
+  // A replacement drone must stay unassigned in the subtree of its plan. The repairs hand the roles
+  // of the failed drone over only in the subtrees of the repaired plans, which are not visited
+  // again, so the drones used below each frame are gathered once, before any repair.
+  auto subtree_assigned_drone_ids = collectSubtreeAssignedDroneIds(subtree_root_frame_id);
+
+  bool is_repaired = true;
+  std::vector<int> stack = { subtree_root_frame_id };   // the frames whose outgoing formation plans are to be repaired
+  while(!stack.empty()) {
+    int frame_id = stack.back();
+    stack.pop_back();
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+
+    for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+      if (!cf_plan.isFormationPlanExist(frame_id, child_frame_id)) continue;
+      auto& fplan = cf_plan.getFormationPlan(frame_id, child_frame_id);
+      auto& assignment2 = fplan.getAssignment2();
+
+      int pixel2_id = assignment2.getPixelId(failed_drone_id);
+      if (pixel2_id < 0) {   // the failed drone is hidden in this formation plan
+        stack.push_back(child_frame_id);
+        continue;
+      }
+
+      // the micro frames before micro_frame_step_count have been shown already
+      int first_micro_frame_id = (frame_id == frame_tree.getRootFrameId()) ? micro_frame_step_count : 0;
+      int remaining_micro_frame_num = micro_frame_num - first_micro_frame_id;
+      auto& formation1 = fplan.getFormation1();
+      auto& start_formation = (first_micro_frame_id == 0) ? formation1 : fplan.getMicroFormation(first_micro_frame_id - 1);
+
+      int replacement_drone_id = findReplacementDroneId(frame_id, child_frame_id, pixel2_id, start_formation, subtree_assigned_drone_ids.at(child_frame_id));
+      if (replacement_drone_id < 0) {   // no hidden drone is free in the whole subtree
+        is_repaired = false;
+        continue;
+      }
+      Pos3D replacement_drone_pos = start_formation.getDroneState(replacement_drone_id).getPos();
+
+      // the replacement drone takes over the role of the failed drone in this formation plan and in the subtree
+      fplan.swapDroneIds(failed_drone_id, replacement_drone_id, false, first_micro_frame_id);
+      handOverDroneRole(child_frame_id, failed_drone_id, replacement_drone_id);
+      int hidden_since_depth = fplan.getHiddenSinceDepths().empty() ? -1 : fplan.getHiddenSinceDepth(failed_drone_id);   // swapped from the replacement drone
+
+      // the replacement drone is planned to fly to the pixel in the remaining micro frames, and
+      // is slowed down to the speed limit if the pixel is too far
+      auto pixel2 = frame_tree.getFrame(child_frame_id).getPixel(pixel2_id);
+      for(int micro_frame_id = first_micro_frame_id; micro_frame_id < micro_frame_num; micro_frame_id++) {
+        double t = static_cast<double>(micro_frame_id - first_micro_frame_id + 1) / static_cast<double>(remaining_micro_frame_num);
+        Pos3D pos(replacement_drone_pos.x + (pixel2.x - replacement_drone_pos.x) * t,
+                  replacement_drone_pos.y + (pixel2.y - replacement_drone_pos.y) * t,
+                  replacement_drone_pos.z + (pixel2.z - replacement_drone_pos.z) * t);
+        auto color = (micro_frame_id == micro_frame_num - 1) ? pixel2.getColor() : COLOR_HIDDEN;
+        fplan.getMicroFormation(micro_frame_id).setDroneState(replacement_drone_id, pos, color);
+      }
+      limitReplacementDroneSpeed(frame_id, child_frame_id, replacement_drone_id, replacement_drone_pos, hidden_since_depth);
+    }
+  }
+  return is_repaired;
+}
+
+
+void SpicompSimulator::handOverDroneRole(int subtree_root_frame_id, int failed_drone_id, int replacement_drone_id) {
+  auto& frame_tree = game_controller.getFrameTree();
+  std::vector<int> stack = { subtree_root_frame_id };
+  while(!stack.empty()) {
+    int frame_id = stack.back();
+    stack.pop_back();
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+
+    for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+      if (!cf_plan.isFormationPlanExist(frame_id, child_frame_id)) continue;
+      cf_plan.getFormationPlan(frame_id, child_frame_id).swapDroneIds(failed_drone_id, replacement_drone_id, true);
+      stack.push_back(child_frame_id);
+    }
+  }
+}
+
+
+void SpicompSimulator::pinFailedDrone(int subtree_root_frame_id, int failed_drone_id, const Pos3D& failed_drone_pos) {
+  // the failed drone may be flying dark toward a later pixel or a staging target in any plan, not
+  // only in the plans after the one in which it is replaced
+  auto& frame_tree = game_controller.getFrameTree();
+  std::vector<int> stack = { subtree_root_frame_id };
+  while(!stack.empty()) {
+    int frame_id = stack.back();
+    stack.pop_back();
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+
+    for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+      if (!cf_plan.isFormationPlanExist(frame_id, child_frame_id)) continue;
+      stack.push_back(child_frame_id);
+      auto& fplan = cf_plan.getFormationPlan(frame_id, child_frame_id);
+      if (fplan.getAssignment2().isDroneAssigned(failed_drone_id)) continue;   // a pixel that could not be repaired
+
+      int first_micro_frame_id = (frame_id == frame_tree.getRootFrameId()) ? micro_frame_step_count : 0;
+      if (first_micro_frame_id == 0) {
+        fplan.getFormation1().setDroneState(failed_drone_id, failed_drone_pos, COLOR_HIDDEN);
+      }
+      for(int micro_frame_id = first_micro_frame_id; micro_frame_id < micro_frame_num; micro_frame_id++) {
+        fplan.getMicroFormation(micro_frame_id).setDroneState(failed_drone_id, failed_drone_pos, COLOR_HIDDEN);
+      }
+    }
+  }
+}
+
+
+void SpicompSimulator::limitReplacementDroneSpeed(int frame_id, int child_frame_id, int replacement_drone_id, const Pos3D& start_pos, int hidden_since_depth) {
+  // The replacement drone follows its planned positions as closely as the speed limit allows and
+  // stays dark until it catches up with them, possibly in the formation plans of the subtree. A
+  // frame that it does not reach in time shows its pixel uncovered: the drone is dark and off the
+  // pixel there, so it is taken out of the assignments at that frame, and the next replan assigns
+  // the pixel as a new pixel, most likely to the same drone.
+  auto& frame_tree = game_controller.getFrameTree();
+  const double max_distance = MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME / static_cast<double>(micro_frame_num);
+
+  struct Flight { int frame1_id; int frame2_id; Pos3D pos; };
+  std::vector<Flight> stack = { { frame_id, child_frame_id, start_pos } };
+  while(!stack.empty()) {
+    auto [frame1_id, frame2_id, pos] = stack.back();
+    stack.pop_back();
+    if (!cf_plan.isFormationPlanExist(frame1_id, frame2_id)) continue;
+    auto& fplan = cf_plan.getFormationPlan(frame1_id, frame2_id);
+
+    auto& assignment1 = fplan.getAssignment1();
+    if (assignment1.isDroneAssigned(replacement_drone_id)) {   // dark at frame1, since the parent plan did not catch up
+      assignment1.unassign(assignment1.getPixelId(replacement_drone_id));
+    }
+    int first_micro_frame_id = (frame1_id == frame_tree.getRootFrameId()) ? micro_frame_step_count : 0;
+    if (first_micro_frame_id == 0 && fplan.getFormation1().getDroneState(replacement_drone_id).getPos() != pos) {
+      fplan.getFormation1().setDroneState(replacement_drone_id, pos, COLOR_HIDDEN);
+    }
+    bool is_caught_up = false;
+    for(int micro_frame_id = first_micro_frame_id; micro_frame_id < micro_frame_num && !is_caught_up; micro_frame_id++) {
+      auto& formation = fplan.getMicroFormation(micro_frame_id);
+      auto planned_pos = std::as_const(formation).getDroneState(replacement_drone_id).getPos();
+      auto distance = pos.distance(planned_pos);
+      if (distance <= max_distance) {   // the planned positions from here on are within the speed limit
+        is_caught_up = true;
+      } else {   // shortened by the rounding error of the stored position, as in computeEarliestAvailableMicroFormations()
+        double step_distance = max_distance - MAX_STORED_POSITION_ERROR;
+        pos.translate((planned_pos.x - pos.x) * step_distance / distance, (planned_pos.y - pos.y) * step_distance / distance, (planned_pos.z - pos.z) * step_distance / distance);
+        formation.setDroneState(replacement_drone_id, pos, COLOR_HIDDEN);
+        pos = std::as_const(formation).getDroneState(replacement_drone_id).getPos();
+      }
+    }
+    if (is_caught_up) continue;
+
+    auto& assignment2 = fplan.getAssignment2();
+    if (assignment2.isDroneAssigned(replacement_drone_id)) assignment2.unassign(assignment2.getPixelId(replacement_drone_id));
+    if (hidden_since_depth >= 0) fplan.setHiddenSinceDepth(replacement_drone_id, hidden_since_depth);
+    if (frame_tree.isTerminalFrame(frame2_id)) continue;
+    for(auto [option, frame3_id] : frame_tree.getAllChildrenIdsWithOptions(frame2_id)) {
+      stack.push_back({ frame2_id, frame3_id, pos });
+    }
+  }
+}
+
+
+int SpicompSimulator::findReplacementDroneId(int frame_id, int child_frame_id, int pixel2_id, const Formation& start_formation,
+                                             const DynamicBitset& subtree_assigned_drone_ids) const {
+  auto& fplan = cf_plan.getFormationPlan(frame_id, child_frame_id);
+
+  // a replacement drone must be dark in this formation plan and must stay unassigned in the whole subtree
+  DynamicBitset is_used = fplan.getAssignment1().getAssignedDroneIds();
+  is_used |= fplan.getAssignment2().getAssignedDroneIds();
+  is_used |= subtree_assigned_drone_ids;
+
+  // the nearest one is the most likely to reach the pixel in time
+  auto pos2 = game_controller.getFrameTree().getFrame(child_frame_id).getPos(pixel2_id);
+  MinKeeper<int, double> nearest_drone_id(-1);
+  (drone_availability - is_used).forEachSetBit([&](int drone_id) {
+    nearest_drone_id.insert(drone_id, start_formation.getDroneState(drone_id).getPos().distance(pos2));
+  });
+  return nearest_drone_id.getMinData();
+}
+
+
+std::unordered_map<int, DynamicBitset> SpicompSimulator::collectSubtreeAssignedDroneIds(int subtree_root_frame_id) const {
+  auto& frame_tree = game_controller.getFrameTree();
+  std::vector<int> frame_ids;   // in preorder, so that the children of a frame come after it
+  std::vector<int> stack = { subtree_root_frame_id };
+  while(!stack.empty()) {
+    int frame_id = stack.back();
+    stack.pop_back();
+    frame_ids.push_back(frame_id);
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+    for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+      if (cf_plan.isFormationPlanExist(frame_id, child_frame_id)) stack.push_back(child_frame_id);
+    }
+  }
+
+  std::unordered_map<int, DynamicBitset> subtree_assigned_drone_ids;
+  subtree_assigned_drone_ids.reserve(frame_ids.size());
+  for(auto iter = frame_ids.rbegin(); iter != frame_ids.rend(); ++iter) {   // the children first
+    int frame_id = *iter;
+    DynamicBitset assigned_drone_ids(drone_num);
+    if (!frame_tree.isTerminalFrame(frame_id)) {
+      for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+        if (!cf_plan.isFormationPlanExist(frame_id, child_frame_id)) continue;
+        assigned_drone_ids |= cf_plan.getFormationPlan(frame_id, child_frame_id).getAssignment2().getAssignedDroneIds();
+        assigned_drone_ids |= subtree_assigned_drone_ids.at(child_frame_id);
+      }
+    }
+    subtree_assigned_drone_ids.emplace(frame_id, std::move(assigned_drone_ids));
+  }
+  return subtree_assigned_drone_ids;
+}
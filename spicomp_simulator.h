@@ -2,25 +2,69 @@
 #define SPICOMP_SPICOMP_SIMULATOR_H
 
 #include <unordered_map>
+#include <unordered_set>
 #include <list>
 #include <deque>
+#include <cstdint>
+#include <array>
+#include <bit>
+#include <initializer_list>
+#include <span>
+#include <memory>
+#include <memory_resource>
 
 #include "util/rng.h"
 #include "util/math.h"
+#include "util/stl.h"
+#include "util/bitset.h"
+#include "util/precision.h"
 #include "util/string_processing.h"
 
 #include "spicomp_setting.h"
 
 
 #define MAX_MICRO_FRAME_NUM    100
+#define MAX_DECISION_OPTION_NUM  4     // the options of a decision variable are 0, 1, ..., MAX_DECISION_OPTION_NUM - 1
 #define BULLET_JUMP_DISTANCE  50.0
 #define BULLET_MAX_DISTANCE  600.0
+#define MAX_BULLET_NUM  12    // at most one bullet is fired per step, and it lives for at most BULLET_MAX_DISTANCE / BULLET_JUMP_DISTANCE steps
+#define POWER_LEVEL_NUM  4
+#define QUANTIZED_GEOMETRY_STEP_MILLI  25   // the resolution of the stored coordinates, in 1/1000 units, when SPICOMP_QUANTIZED_GEOMETRY is defined
+#define MAX_WORLD_COORD  800.0   // every pixel and drone coordinate lies in [-MAX_WORLD_COORD, MAX_WORLD_COORD]
 #define INIT_FRAMETREE_LENGTH   20
 #define MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME 1000.0
+#define FORMATION_PLAN_CACHE_CAPACITY  1024
+#define FORMATION_PLAN_CACHE_QUANTUM   50.0
+#define FORMATION_CHUNK_SIZE  16      // the number of drone states in a chunk of a formation
+#define CONTINGENCY_FORMATION_PLAN_ARENA_SIZE  (1 << 20)   // the size of a block of the arena of a contingency formation plan
+#define CONTINGENCY_FORMATION_PLAN_MAX_MEMORY_SIZE  (64 << 20)   // the memory ceiling of a contingency formation plan
+#define PIXEL_CORRESPONDENCE_MAX_DISTANCE  100.0   // how far a pixel without identity may move between frames and still be matched
+#define HIERARCHICAL_ASSIGNMENT_MIN_DRONE_NUM  2000   // use the cluster-based assignment if there are this many candidate drones
+#define HIERARCHICAL_ASSIGNMENT_CLUSTER_SIZE     64   // the average number of candidate drones in a grid cell
+#define STAGING_CELL_SIZE  25.0             // the size of a grid cell in which the upcoming new pixels are counted
+#define STAGING_DISTANCE_PER_FRAME  200.0   // how far an idle hidden drone moves toward its staging target per frame
+#define FRONTIER_EXPANSION_GRAIN_SIZE             8   // the minimum number of terminal game states expanded by a thread
 
 // TODO: MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME is too large
 
 
+// The precision in which the drone states of formations, and hence the formation plans, are stored.
+// The geometry is always computed in double.
+#if defined(SPICOMP_FLOAT_GEOMETRY)
+using GeometryPrecision = FloatPrecision;
+#elif defined(SPICOMP_QUANTIZED_GEOMETRY)
+using GeometryPrecision = QuantizedPrecision<QUANTIZED_GEOMETRY_STEP_MILLI>;
+#else
+using GeometryPrecision = DoublePrecision;
+#endif
+
+static_assert(MAX_WORLD_COORD <= GeometryPrecision::MAX_ABS_VALUE, "the stored coordinates would be clamped");
+static_assert(BULLET_MAX_DISTANCE < MAX_WORLD_COORD);
+
+// how far a stored position may be from the position it encodes (2 > sqrt(3) for the three coordinates)
+inline constexpr double MAX_STORED_POSITION_ERROR = 2.0 * GeometryPrecision::getMaxEncodingError(MAX_WORLD_COORD);
+
+
 // -------------------------------------------------------------------------------------------
 
 struct Pos3D {
@@ -30,7 +74,8 @@ struct Pos3D {
 
   Pos3D(double x, double y, double z) : x(x), y(y), z(z) {}
 
-  Pos3D(const Pos3D& pos) : x(pos.x), y(pos.y), z(pos.z) {}
+  Pos3D(const Pos3D& pos) = default;
+  Pos3D& operator=(const Pos3D& pos) = default;
 
 
   void translate(double dx, double dy, double dz) {
@@ -65,28 +110,36 @@ struct Pos3D {
 };
 
 
+// the cells of a sparse uniform grid are hashed by their integer coordinates, 21 bits per coordinate
+inline std::int64_t getGridCellCoord(double v, double cell_size) {
+  return static_cast<std::int64_t>(std::floor(v / cell_size));
+}
+
+inline std::int64_t getGridCellKey(std::int64_t cx, std::int64_t cy, std::int64_t cz) {
+  return ((cx & 0x1FFFFF) << 42) | ((cy & 0x1FFFFF) << 21) | (cz & 0x1FFFFF);
+}
+
+inline std::int64_t getGridCellKey(double x, double y, double z, double cell_size) {
+  return getGridCellKey(getGridCellCoord(x, cell_size), getGridCellCoord(y, cell_size), getGridCellCoord(z, cell_size));
+}
+
+
 struct Color3D {
-  int red, green, blue;
+  std::uint8_t red, green, blue;
 
   Color3D() : red(0), green(0), blue(0) {}
 
   Color3D(float red, float green, float blue) : red(red), green(green), blue(blue) {}
 
-  Color3D(const Color3D& color) : red(color.red), green(color.green), blue(color.blue) {}
-
-  void operator=(const Color3D& color) {
-    red = color.red;
-    green = color.green;
-    blue = color.blue;
-  }
+  Color3D(const Color3D& color) = default;
+  Color3D& operator=(const Color3D& color) = default;
 
   friend bool operator==(const Color3D& l, const Color3D& r) {
     return l.red == r.red && l.green == r.green && l.blue == r.blue;
   }
 
   friend std::ostream& operator<<(std::ostream& out, const Color3D& pos) {
-    out << std::fixed << std::setprecision(1);
-    out << '(' << pos.red << " " << pos.green << " " << pos.blue << ')';
+    out << '(' << static_cast<int>(pos.red) << " " << static_cast<int>(pos.green) << " " << static_cast<int>(pos.blue) << ')';
     return out;
   }
 
@@ -158,102 +211,148 @@ struct Pixel : public Pos3D, Color3D {
 //   Formation
 // -------------------------------------------------------------------------------------------
 
-class DroneState {
+// The state of a drone, whose position is stored in the precision given by the policy (see
+// util/precision.h). getPos() decodes the position, so the callers always compute in double.
 
-  Pos3D pos;
+template<typename Precision>
+class BasicDroneState {
+
+  using Coord = typename Precision::Coord;
+
+  Coord x, y, z;
   Color3D color;
   bool isHidden;
 
 public:
 
-  DroneState(double x, double y, double z) :
-      pos(x, y, z), color(COLOR_HIDDEN), isHidden(false)
-  {
-    // do nothing
-  }
+  BasicDroneState() : BasicDroneState(0.0, 0.0, 0.0, COLOR_HIDDEN) {}
 
-  DroneState(double x, double y, double z, const Color3D& color) :
-      pos(x, y, z), color(color), isHidden(color==COLOR_HIDDEN)
+  BasicDroneState(double x, double y, double z) :
+      x(Precision::encode(x)), y(Precision::encode(y)), z(Precision::encode(z)), color(COLOR_HIDDEN), isHidden(false)
   {
     // do nothing
   }
 
-  DroneState(const Pixel& pixel) :
-      pos(pixel.x, pixel.y, pixel.z), color(pixel), isHidden(color==COLOR_HIDDEN)
+  BasicDroneState(double x, double y, double z, const Color3D& color) :
+      x(Precision::encode(x)), y(Precision::encode(y)), z(Precision::encode(z)), color(color), isHidden(color==COLOR_HIDDEN)
   {
     // do nothing
   }
 
-  explicit DroneState(const DroneState& state) : pos(state.pos), color(state.color), isHidden(state.isHidden) {}
+  BasicDroneState(const Pixel& pixel) : BasicDroneState(pixel.x, pixel.y, pixel.z, pixel.getColor()) {}
 
-  void operator=(const DroneState& state) {
-    pos = state.pos;
-    color = state.color;
-    isHidden = state.isHidden;
-  }
+  BasicDroneState(const BasicDroneState& state) = default;
+  BasicDroneState& operator=(const BasicDroneState& state) = default;
 
 
-  const Pos3D& getPos() const { return pos; }
+  Pos3D getPos() const { return Pos3D(Precision::decode(x), Precision::decode(y), Precision::decode(z)); }
   const Color3D getColor() const { return color; }
   bool getIsHidden() const { return isHidden; }
 
   Pixel getPixel() const {
-    return Pixel(pos.x, pos.y, pos.z, color);
+    return Pixel(getPos(), color);
+  }
+
+  bool isSameAs(const Pos3D& pos, const Color3D& color) const {   // whether setting pos and color would not change the stored state
+    return x == Precision::encode(pos.x) && y == Precision::encode(pos.y) && z == Precision::encode(pos.z) &&
+           BasicDroneState::color == color && isHidden == (color == COLOR_HIDDEN);
   }
 
 
-  void setPos(const Pos3D& pos) { DroneState::pos = pos; }
-  void setPos(double x, double y, double z) { DroneState::pos = Pos3D(x, y, z); }
+  void setPos(const Pos3D& pos) { setPos(pos.x, pos.y, pos.z); }
+  void setPos(double x, double y, double z) {
+    BasicDroneState::x = Precision::encode(x);
+    BasicDroneState::y = Precision::encode(y);
+    BasicDroneState::z = Precision::encode(z);
+  }
 
   void setColor(const Color3D& color) {
-    DroneState::color = color;
+    BasicDroneState::color = color;
     isHidden = (color == COLOR_HIDDEN);
   }
 
 };
 
 
+using DroneState = BasicDroneState<GeometryPrecision>;
+
+
 // -------------------------------------------------------------------------------------------
 //   Frame
 // -------------------------------------------------------------------------------------------
 
+// The pixels of a frame are stored as columns, so that translating a frame and scanning its
+// coordinates are loops over contiguous arrays that the compiler can vectorize. A frame is built
+// with a FrameBuilder and its columns are immutable once built, so the copies of a frame share
+// them, even across threads, and copying a frame tree does not copy the pixels. An empty frame
+// allocates no columns.
+
 class Frame {
 
-  int id;
-  std::vector<Pixel> pixel_db;
+  struct Columns {
+    std::vector<double> xs;
+    std::vector<double> ys;
+    std::vector<double> zs;
+    std::vector<Color3D> colors;
+    std::vector<int> pixel_identities;   // stable identities of the pixels across frames; empty if the frame source has none
+  };
+
+  inline static const Columns EMPTY_COLUMNS{};
+
+  int id = -1;
+  std::shared_ptr<const Columns> columns;   // nullptr for an empty frame
+
+  const Columns& getColumns() const { return columns ? *columns : EMPTY_COLUMNS; }
+
+  explicit Frame(std::shared_ptr<const Columns> columns) : columns{std::move(columns)} {}
+
+  friend class FrameBuilder;
 
 public:
 
   Frame() = default;
-  Frame(const Frame& frame) : id(frame.id), pixel_db(frame.pixel_db) {}
-
-  void operator=(const Frame& frame) { id = frame.id; pixel_db = frame.pixel_db; }
+  Frame(const Frame& frame) = default;
+  Frame(Frame&& frame) = default;
+  Frame& operator=(const Frame& frame) = default;
+  Frame& operator=(Frame&& frame) = default;
 
 
   int getId() const { return id; }
-  int size() const { return pixel_db.size(); }
+  int size() const { return getColumns().xs.size(); }
 
-  const Pixel& getPixel(int pixel_id) const { return pixel_db[pixel_id]; }
-  const std::vector<Pixel>& getPixels() const { return pixel_db; }
+  Pixel getPixel(int pixel_id) const { auto& c = getColumns(); return Pixel(c.xs[pixel_id], c.ys[pixel_id], c.zs[pixel_id], c.colors[pixel_id]); }
+  Pos3D getPos(int pixel_id) const { auto& c = getColumns(); return Pos3D(c.xs[pixel_id], c.ys[pixel_id], c.zs[pixel_id]); }
+  const Color3D& getColor(int pixel_id) const { return getColumns().colors[pixel_id]; }
 
+  std::span<const double> getXs() const { return getColumns().xs; }
+  std::span<const double> getYs() const { return getColumns().ys; }
+  std::span<const double> getZs() const { return getColumns().zs; }
+  std::span<const Color3D> getColors() const { return getColumns().colors; }
 
-  void setId(int id) { Frame::id = id; }
+  bool hasPixelIdentities() const { auto& c = getColumns(); return !c.xs.empty() && c.pixel_identities.size() == c.xs.size(); }
+  int getPixelIdentity(int pixel_id) const { return getColumns().pixel_identities[pixel_id]; }
 
-  void addPixel(double x, double y, double z, const Color3D& color) {
-    pixel_db.emplace_back(x, y, z, color);
-  }
+  bool isSharingPixels(const Frame& frame) const { return columns == frame.columns; }
 
-  void addPixel(const Pixel& pixel) { pixel_db.push_back(pixel); }
 
-  void translate(double x, double y, double z) {
-    for(auto& pixel : pixel_db) {
-      pixel.translate(x, y, z);
-    }
+  void setId(int id) { Frame::id = id; }
+
+  void translate(double x, double y, double z) {   // translate a copy of the columns, which the other copies of the frame do not see
+    if (!columns) return;
+    auto c = std::make_shared<Columns>(*columns);
+    for(auto& v : c->xs) { v += x; }
+    for(auto& v : c->ys) { v += y; }
+    for(auto& v : c->zs) { v += z; }
+    columns = std::move(c);
   }
 
   friend std::ostream& operator<<(std::ostream& out, const Frame& frame) {
+    std::vector<Pixel> pixels;
+    for(int pixel_id = 0; pixel_id < frame.size(); pixel_id++) {
+      pixels.push_back(frame.getPixel(pixel_id));
+    }
     out << "{Frame" << frame.id << ": ";
-    out << to_string(frame.pixel_db);
+    out << to_string(pixels);
     out << '}';
     return out;
   }
@@ -261,11 +360,114 @@ public:
 };
 
 
+// Collects the pixels of a frame in local columns and publishes them in build(), after which they
+// are never written again.
+//
+// Usage: FrameBuilder builder;  builder.addPixel(pixel, identity);  Frame frame = builder.build(frame_id);
+
+class FrameBuilder {
+
+  Frame::Columns columns;
+
+public:
+
+  int size() const { return columns.xs.size(); }
+
+  void reserve(int pixel_num) {
+    columns.xs.reserve(pixel_num);
+    columns.ys.reserve(pixel_num);
+    columns.zs.reserve(pixel_num);
+    columns.colors.reserve(pixel_num);
+    columns.pixel_identities.reserve(pixel_num);
+  }
+
+  void addPixel(double x, double y, double z, const Color3D& color) {
+    columns.xs.push_back(x);
+    columns.ys.push_back(y);
+    columns.zs.push_back(z);
+    columns.colors.push_back(color);
+  }
+
+  void addPixel(const Pixel& pixel) { addPixel(pixel.x, pixel.y, pixel.z, pixel.getColor()); }
+
+  void addPixel(const Pixel& pixel, int identity) {
+    assert(columns.pixel_identities.size() == columns.xs.size());
+    addPixel(pixel);
+    columns.pixel_identities.push_back(identity);
+  }
+
+  void addPixels(const Frame& frame) {   // append all pixels of frame, with their identities
+    assert(columns.pixel_identities.size() == columns.xs.size() && (frame.size() == 0 || frame.hasPixelIdentities()));
+    auto& other = frame.getColumns();
+    columns.xs.insert(columns.xs.end(), other.xs.begin(), other.xs.end());
+    columns.ys.insert(columns.ys.end(), other.ys.begin(), other.ys.end());
+    columns.zs.insert(columns.zs.end(), other.zs.begin(), other.zs.end());
+    columns.colors.insert(columns.colors.end(), other.colors.begin(), other.colors.end());
+    columns.pixel_identities.insert(columns.pixel_identities.end(), other.pixel_identities.begin(), other.pixel_identities.end());
+  }
+
+  Frame build(int frame_id = -1) {   // publish the columns and leave the builder empty
+    Frame frame(columns.xs.empty() ? nullptr : std::make_shared<const Frame::Columns>(std::move(columns)));
+    frame.setId(frame_id);
+    columns = Frame::Columns();
+    return frame;
+  }
+
+};
+
+
 // -------------------------------------------------------------------------------------------
 //   Drone Assignment
 // -------------------------------------------------------------------------------------------
 
-using DroneAssignment = std::vector<int>;
+// A mapping from the pixels of a frame to the drones. It also maintains the inverse mapping from
+// the drones to the pixels and the sets of assigned and unassigned drones, so that membership
+// queries are O(1) and set operations between assignments work on whole words of bits.
+
+class DroneAssignment {
+
+  std::vector<int> drone_ids;   // drone_ids[pixel_id] is the drone of the pixel, or -1 if none
+  std::vector<int> pixel_ids;   // pixel_ids[drone_id] is the pixel of the drone, or -1 if none
+
+  DynamicBitset assigned_drone_ids;
+  DynamicBitset unassigned_drone_ids;
+
+public:
+
+  DroneAssignment() = default;
+
+  DroneAssignment(int pixel_num, int drone_num) :
+      drone_ids(pixel_num, -1), pixel_ids(drone_num, -1), assigned_drone_ids(drone_num, false), unassigned_drone_ids(drone_num, true)
+  {
+    assert(pixel_num <= drone_num);
+  }
+
+  int size() const { return drone_ids.size(); }     // the number of pixels
+  int getDroneNum() const { return pixel_ids.size(); }
+
+  int operator[](int pixel_id) const { return drone_ids[pixel_id]; }
+  int getDroneId(int pixel_id) const { return drone_ids[pixel_id]; }
+  int getPixelId(int drone_id) const { return pixel_ids[drone_id]; }    // return -1 if the drone is not assigned
+
+  bool isDroneAssigned(int drone_id) const { return pixel_ids[drone_id] >= 0; }
+  bool isComplete() const { return assigned_drone_ids.count() == size(); }   // every pixel has a drone
+
+  const std::vector<int>& getDroneIds() const { return drone_ids; }
+  const DynamicBitset& getAssignedDroneIds() const { return assigned_drone_ids; }
+  const DynamicBitset& getUnassignedDroneIds() const { return unassigned_drone_ids; }
+
+  std::vector<int>::const_iterator begin() const { return drone_ids.cbegin(); }
+  std::vector<int>::const_iterator end() const { return drone_ids.cend(); }
+
+  void assign(int pixel_id, int drone_id);   // the drone must not be assigned to another pixel
+  void unassign(int pixel_id);
+
+  void swapDroneIds(int drone_id1, int drone_id2);
+
+  // the drone bitsets are derived from pixel_ids, so comparing both maps compares the whole state
+  bool operator==(const DroneAssignment& other) const { return drone_ids == other.drone_ids && pixel_ids == other.pixel_ids; }
+
+};
 
 
 // -------------------------------------------------------------------------------------------
@@ -281,21 +483,59 @@ void translate(FrameSeq& frame, double x, double y, double z);
 //   The Decision Variable
 // -------------------------------------------------------------------------------------------
 
-using DecisionOption = int;
+using DecisionOption = int;   // 0, 1, ..., MAX_DECISION_OPTION_NUM - 1, or DecisionVariable::NIL
+
+
+// The domain of a decision variable as a bitmask; iterating it yields the options in increasing order.
+
+class DecisionDomain {
+
+  std::uint32_t mask;
+
+public:
+
+  class Iterator {
+    std::uint32_t mask;
+  public:
+    explicit Iterator(std::uint32_t mask) : mask{mask} {}
+    DecisionOption operator*() const { return std::countr_zero(mask); }
+    Iterator& operator++() { mask &= mask - 1; return *this; }
+    bool operator==(const Iterator& other) const { return mask == other.mask; }
+  };
+
+  DecisionDomain() : mask{0} {}
+
+  DecisionDomain(std::initializer_list<DecisionOption> options) : mask{0} {
+    for(auto option : options) {
+      assert(0 <= option && option < MAX_DECISION_OPTION_NUM);
+      mask |= std::uint32_t{1} << option;
+    }
+  }
+
+  int size() const { return std::popcount(mask); }
+  bool empty() const { return mask == 0; }
+  bool contains(DecisionOption option) const { return 0 <= option && option < MAX_DECISION_OPTION_NUM && (mask >> option & 1) != 0; }
+  bool isSubsetOf(const DecisionDomain& domain) const { return (mask & ~domain.mask) == 0; }
+
+  Iterator begin() const { return Iterator(mask); }
+  Iterator end() const { return Iterator(0); }
+
+};
+
 
 class DecisionVariable {
 
   int id;
-  std::vector<DecisionOption> domains;
+  DecisionDomain domains;
   DecisionOption default_option;
 
 public:
 
   DecisionVariable() : id{-1}, default_option{DecisionVariable::NIL} {}
 
-  DecisionVariable(int id, const std::vector<DecisionOption>& domains, DecisionOption default_option) : id(id), domains(domains), default_option(default_option) {
-    assert(!domains.empty());
-    assert(std::find(domains.begin(), domains.end(), default_option) != domains.end());
+  DecisionVariable(int id, std::initializer_list<DecisionOption> domains, DecisionOption default_option) : id(id), domains(domains), default_option(default_option) {
+    assert(!DecisionVariable::domains.empty());
+    assert(DecisionVariable::domains.contains(default_option));
   }
 
 
@@ -304,21 +544,20 @@ public:
 
   int getId() const { return id; }
   int size() const { return domains.size(); }
-  const std::vector<DecisionOption>& getDomains() const { return domains;}
+  const DecisionDomain& getDomains() const { return domains;}
   const DecisionOption& getDefaultOption() const { return default_option; }
-  bool contains(const DecisionOption& option) const { return std::find(domains.begin(), domains.end(), option) != domains.end(); }
+  bool contains(const DecisionOption& option) const { return domains.contains(option); }
 
-  bool isSubdomainOf(const DecisionVariable& decision_variable) const {
-    for(auto& option : domains) {
-      if (!decision_variable.contains(option)) return false;
-    }
-    return true;
-  }
+  bool isSubdomainOf(const DecisionVariable& decision_variable) const { return domains.isSubsetOf(decision_variable.domains); }
 
   friend std::ostream& operator<<(std::ostream& out, const DecisionVariable& decision_variable) {
     if (decision_variable.isExist()) {
       out << "<v" << decision_variable.id << "=" << decision_variable.default_option << ">={";
-      out << to_string(decision_variable.domains);
+      bool is_first = true;
+      for(auto option : decision_variable.domains) {
+        out << (is_first ? "" : ",") << option;
+        is_first = false;
+      }
       out << '}';
     } else {
       out << "<v?=nil>";
@@ -330,236 +569,517 @@ public:
 };
 
 
+// The children of a node in a tree, indexed by the decision option (or NIL for the unique
+// child) in an inline array, so that looking up a child takes no hashing and no allocation.
+// Iterating the children yields (option, child_id) pairs with NIL first.
+
+class DecisionChildren {
+
+  std::array<int, MAX_DECISION_OPTION_NUM + 1> child_ids;   // child_ids[option + 1] is the child id of option, or -1
+  int child_num;
+
+  static int getIndex(DecisionOption option) {
+    assert(option == DecisionVariable::NIL || (0 <= option && option < MAX_DECISION_OPTION_NUM));
+    return option + 1;
+  }
+
+public:
+
+  class Iterator {
+    const DecisionChildren* children;
+    int index;
+  public:
+    Iterator(const DecisionChildren* children, int index) : children{children}, index{index} { skip(); }
+    std::pair<DecisionOption, int> operator*() const { return { index - 1, children->child_ids[index] }; }
+    Iterator& operator++() { index++; skip(); return *this; }
+    bool operator==(const Iterator& other) const { return index == other.index; }
+  private:
+    void skip() { while(static_cast<std::size_t>(index) < children->child_ids.size() && children->child_ids[index] < 0) index++; }
+  };
+
+  DecisionChildren() : child_num{0} { child_ids.fill(-1); }
+
+  int size() const { return child_num; }
+  bool empty() const { return child_num == 0; }
+  bool contains(DecisionOption option) const { return child_ids[getIndex(option)] >= 0; }
+  int at(DecisionOption option) const { assert(contains(option)); return child_ids[getIndex(option)]; }
+
+  void set(DecisionOption option, int child_id) {
+    assert(child_id >= 0);
+    if (!contains(option)) child_num++;
+    child_ids[getIndex(option)] = child_id;
+  }
+
+  void erase(DecisionOption option) {
+    if (contains(option)) child_num--;
+    child_ids[getIndex(option)] = -1;
+  }
+
+  Iterator begin() const { return Iterator(this, 0); }
+  Iterator end() const { return Iterator(this, child_ids.size()); }
+
+};
+
+
 // -------------------------------------------------------------------------------------------
-//   The Frame Tree
+//   The Contingency Tree
 // -------------------------------------------------------------------------------------------
 
-class FrameTree {
+// A tree of payloads (frames or game states) in which a node is either a decision node, whose
+// children are indexed by the options of its decision variable, or a node with a unique child.
+// The payload, the decision variable, the children and the parent link of a node are stored
+// together, so that each query or update hashes the node id once. The terminal nodes (the
+// frontier) are kept in a list that is updated as children are added and removed, so that the
+// frontier can be read without walking the tree. pop_front() only detaches the discarded
+// branches; their nodes are reclaimed later by reclaimDiscardedNodes(), which is meant to run
+// off the critical path. The payload must provide getId(), which is the id of its node.
 
-  int root_frame_id;
-  std::unordered_map<int, Frame> frame_db;
-  std::unordered_map<int, DecisionVariable> frame_decision_var_db;
-  std::unordered_map<int, std::unordered_map<DecisionOption,int>> children_ids_db;
-  std::unordered_map<int, int> parent_frame_id_db;
-  std::unordered_map<int, DecisionOption> parent_option_db;
+template<typename Payload>
+class ContingencyTree {
 
-public:
+  struct Node {
+    Payload payload;
+    DecisionVariable decision_variable;   // does not exist if the node is not a decision node
+    DecisionChildren children;
+    int parent_id = -1;
+    DecisionOption parent_option = DecisionVariable::NIL;
+    int terminal_index = -1;              // the index in terminal_ids, or -1 if the node is not terminal
 
-  FrameTree() : root_frame_id(-1) {}
+    explicit Node(const Payload& payload) : payload(payload) {}
+    explicit Node(Payload&& payload) : payload(std::move(payload)) {}
+  };
 
-  bool empty() const { return frame_db.empty(); }   // root_frame_id = -1 as well
-  int size() const { return frame_db.size(); }
-  void clear() {
-    root_frame_id = -1;
-    frame_db.clear();
-    frame_decision_var_db.clear();
-    children_ids_db.clear();
-    parent_frame_id_db.clear();
-    parent_option_db.clear();
+  int root_id;
+  std::unordered_map<int, Node> node_db;
+  std::vector<int> terminal_ids;
+  std::vector<int> discarded_ids;   // the roots of the detached branches that are not reclaimed yet
+
+  const Node* findNode(int id) const {
+    auto iter = node_db.find(id);
+    return (iter == node_db.end()) ? nullptr : &iter->second;
   }
 
+  const Node& getNode(int id) const { return node_db.at(id); }
+  Node& getNode(int id) { return node_db.at(id); }
+
+  void addTerminalId(int id, Node& node) {
+    assert(node.terminal_index < 0);
+    node.terminal_index = terminal_ids.size();
+    terminal_ids.push_back(id);
+  }
+
+  void removeTerminalId(Node& node) {   // swap with the last terminal id
+    assert(node.terminal_index >= 0);
+    auto last_id = terminal_ids.back();
+    terminal_ids[node.terminal_index] = last_id;
+    getNode(last_id).terminal_index = node.terminal_index;
+    terminal_ids.pop_back();
+    node.terminal_index = -1;
+  }
+
+public:
+
+  ContingencyTree() : root_id(-1) {}
+
+  bool empty() const { return node_db.empty(); }   // root_id = -1 as well
+  int size() const { return node_db.size(); }       // including the discarded nodes that are not reclaimed yet
+  void clear() { root_id = -1; node_db.clear(); terminal_ids.clear(); discarded_ids.clear(); }
+  void reserve(int node_num) { node_db.reserve(node_num); }   // reserve the capacity before adding nodes in bulk
+
   // --- Query ---
 
-  int getRootFrameId() const { return root_frame_id; }
-  const Frame& getRootFrame() const { return frame_db.at(root_frame_id); }
+  int getRootId() const { return root_id; }
+  const Payload& getRoot() const { return getPayload(root_id); }
 
-  bool isFrameExist(int frame_id) const { return frame_db.contains(frame_id); }
-  const Frame& getFrame(int frame_id) const { return frame_db.at(frame_id); }
-  const std::unordered_map<int, Frame>& getAllFrames() const { return frame_db; }
+  bool isNodeExist(int id) const { return node_db.contains(id); }
+  const Payload& getPayload(int id) const { return getNode(id).payload; }
 
-  bool isDecisionFrame(int frame_id) const { return frame_decision_var_db.contains(frame_id); }
-  const DecisionVariable& getDecisionVariable(int frame_id) const { return frame_decision_var_db.at(frame_id); }
-  bool hasOption(int frame_id, const DecisionOption& option) const { return getDecisionVariable(frame_id).contains(option); }
-  const DecisionOption& getDefaultOption(int frame_id) const { return getDecisionVariable(frame_id).getDefaultOption(); }
+  bool isDecisionNode(int id) const { auto node = findNode(id); return node != nullptr && node->decision_variable.isExist(); }
+  const DecisionVariable& getDecisionVariable(int id) const { assert(isDecisionNode(id)); return getNode(id).decision_variable; }
+  bool hasOption(int id, const DecisionOption& option) const { return getDecisionVariable(id).contains(option); }
+  const DecisionOption& getDefaultOption(int id) const { return getDecisionVariable(id).getDefaultOption(); }
 
-  bool isTerminalFrame(int frame_id) const { return !children_ids_db.contains(frame_id); }
-  bool hasChildOption(int frame_id, const DecisionOption& option) const { return children_ids_db.at(frame_id).contains(option); }
-  bool hasChildNilOption(int frame_id) const { return hasChildOption(frame_id, DecisionVariable::NIL); }
-  bool hasChildFrameId(int frame_id, int child_id) const {
-    for(auto [ option, child_id_2]: children_ids_db.at(frame_id)) { if (child_id_2 == child_id) return true; }
+  bool isTerminalNode(int id) const { auto node = findNode(id); return node == nullptr || node->children.empty(); }
+  bool hasChildOption(int id, const DecisionOption& option) const { return getNode(id).children.contains(option); }
+  bool hasChildId(int id, int child_id) const {
+    for(auto [option, child_id_2] : getNode(id).children) { if (child_id_2 == child_id) return true; }
     return false;
   }
-  bool hasChildFrameIdWithOption(int frame_id, const DecisionOption& option, int child_id) const {
-    return !isTerminalFrame(frame_id) && hasChildOption(frame_id, option) && children_ids_db.at(frame_id).at(option) == child_id;
-  }
-  bool hasChildFrameIdWithoutOption(int frame_id, int child_id) const {
-    return !isTerminalFrame(frame_id) && hasChildNilOption(frame_id) && children_ids_db.at(frame_id).at(DecisionVariable::NIL) == child_id;
+  bool hasChildIdWithOption(int id, const DecisionOption& option, int child_id) const {
+    return !isTerminalNode(id) && hasChildOption(id, option) && getNode(id).children.at(option) == child_id;
   }
 
-  int getChildFrameId(int frame_id, const DecisionOption& option) const { assert(isDecisionFrame(frame_id)); return children_ids_db.at(frame_id).at(option); }
-  int getUniqueChildFrameId(int frame_id) const { assert(!isDecisionFrame(frame_id)); return children_ids_db.at(frame_id).at(DecisionVariable::NIL); }
-  int getDefaultChildFrameId(int frame_id) const { assert(isDecisionFrame(frame_id)); return children_ids_db.at(frame_id).at(getDecisionVariable(frame_id).getDefaultOption()); }
-  const Frame& getChildFrame(int frame_id, const DecisionOption& option) const { assert(isDecisionFrame(frame_id)); return getFrame(getChildFrameId(frame_id, option)); }
-  const Frame& getUniqueChildFrame(int frame_id) const { assert(!isDecisionFrame(frame_id)); return getFrame(getUniqueChildFrameId(frame_id)); }
-  const Frame& getDefaultChildFrame(int frame_id) const { assert(isDecisionFrame(frame_id)); return getFrame(getDefaultChildFrameId(frame_id)); }
-  const std::unordered_map<DecisionOption,int>& getAllChildrenIdsWithOptions(int frame_id) const { return children_ids_db.at(frame_id); }
+  int getChildId(int id, const DecisionOption& option) const { assert(isDecisionNode(id)); return getNode(id).children.at(option); }
+  int getUniqueChildId(int id) const { assert(!isDecisionNode(id)); return getNode(id).children.at(DecisionVariable::NIL); }
+  int getDefaultChildId(int id) const { auto& node = getNode(id); assert(node.decision_variable.isExist()); return node.children.at(node.decision_variable.getDefaultOption()); }
+  const DecisionChildren& getChildren(int id) const { return getNode(id).children; }
 
-  int hasParentFrameId(int frame_id) const { return parent_frame_id_db.contains(frame_id); }
-  int getParentFrameId(int frame_id) const { return parent_frame_id_db.at(frame_id); }
-  int getParentOption(int frame_id) const { return parent_option_db.at(frame_id); }
+  bool hasParentId(int id) const { auto node = findNode(id); return node != nullptr && node->parent_id >= 0; }
+  int getParentId(int id) const { assert(hasParentId(id)); return getNode(id).parent_id; }
+  DecisionOption getParentOption(int id) const { assert(hasParentId(id)); return getNode(id).parent_option; }
+
+  std::span<const int> getTerminalIds() const { assert(!hasDiscardedNodes()); return terminal_ids; }   // in no particular order
+
+  std::vector<int> getNextTerminalIds() const;   // the terminal ids that remain after pop_front()
 
   // --- Update ---
 
-  void setRootFrameId(int frame_id) {
-    assert(root_frame_id == -1);
-    root_frame_id = frame_id;
-  }
-
-  void addFrame(const Frame& frame) {
-    auto frame_id = frame.getId();
-    assert(!isFrameExist(frame_id));
-    assert(!isDecisionFrame(frame_id));  // must not have the decision variable before adding the frame
-    assert(isTerminalFrame(frame_id));   // must not have any children before adding the frame
-    frame_db[frame_id] = frame;
-  }
-
-  void removeFrame(int frame_id) {
-    assert(isFrameExist(frame_id));
-    assert(!isDecisionFrame(frame_id));  // must remove the decision variable before removing the frame
-    assert(isTerminalFrame(frame_id));   // must remove all children before removing the frame
-    frame_db.erase(frame_id);
-    if (frame_id == root_frame_id) { root_frame_id = -1; } // need to use setRootFrameId() to update root_frame_id after calling removeFrame()
-  }
-
-  void setDecisionVariable(int frame_id, const DecisionVariable& decision_var) {
-    assert(isFrameExist(frame_id));
-    assert(!isDecisionFrame(frame_id));
-    assert(isTerminalFrame(frame_id));   // must not have any children before adding the decision variable
-    frame_decision_var_db.insert({frame_id, decision_var} );
-  }
-
-  void removeDecisionVariable(int frame_id) {
-    assert(isFrameExist(frame_id));
-    assert(isDecisionFrame(frame_id));
-    assert(isTerminalFrame(frame_id));   // must remove all children before removing the decision variable
-    frame_decision_var_db.erase(frame_id);
-  }
-
-  void addChildId(int frame_id, const DecisionOption& option, int child_id) {
-    assert(isFrameExist(frame_id));
-    assert(isFrameExist(child_id));
-    assert(isDecisionFrame(frame_id));
-    assert(hasOption(frame_id, option));
-    assert(!hasChildFrameIdWithOption(frame_id, option, child_id));
-    assert(!hasParentFrameId(child_id));
-    children_ids_db[frame_id][option] = child_id;
-    parent_frame_id_db[child_id] = frame_id;
-    parent_option_db[child_id] = option;
-  }
-
-  void addUniqueChildId(int frame_id, int child_id) {
-    assert(isFrameExist(frame_id));
-    assert(isFrameExist(child_id));
-    assert(!isDecisionFrame(frame_id));
-    assert(!hasChildFrameIdWithoutOption(frame_id, child_id));
-    assert(!hasParentFrameId(child_id));
-    children_ids_db[frame_id][DecisionVariable::NIL] = child_id;
-    parent_frame_id_db[child_id] = frame_id;
-    parent_option_db[child_id] = DecisionVariable::NIL;
-  }
-
-  void removeChildId(int frame_id, const DecisionOption& option, int child_id) {
-    assert(isFrameExist(frame_id));
-    assert(isFrameExist(child_id));
-    assert(isDecisionFrame(frame_id));
-    assert(hasOption(frame_id, option));
-    assert(hasChildFrameIdWithOption(frame_id, option, child_id));
-    assert(hasParentFrameId(child_id));
-    children_ids_db[frame_id].erase(option);
-    parent_frame_id_db.erase(child_id);
-    parent_option_db.erase(child_id);
-    if (children_ids_db[frame_id].empty()) {
-      children_ids_db.erase(frame_id);
-    }
+  void setRootId(int id) {
+    assert(root_id == -1);
+    root_id = id;
   }
 
-  void removeUniqueChildId(int frame_id, int child_id) {
-    assert(isFrameExist(frame_id));
-    assert(isFrameExist(child_id));
-    assert(!isDecisionFrame(frame_id));
-    assert(hasChildFrameIdWithoutOption(frame_id, child_id));
-    assert(hasParentFrameId(child_id));
-    children_ids_db[frame_id].erase(DecisionVariable::NIL);
-    parent_frame_id_db.erase(child_id);
-    parent_option_db.erase(child_id);
-    if (children_ids_db[frame_id].empty()) {
-      children_ids_db.erase(frame_id);
-    }
+  void addNode(const Payload& payload) { addNode(Payload(payload)); }
+
+  void addNode(Payload&& payload) {
+    auto id = payload.getId();
+    assert(!isNodeExist(id));
+    auto& node = node_db.emplace(id, Node(std::move(payload))).first->second;
+    addTerminalId(id, node);
   }
 
-  void attachFrameSubtreeToTerminalFrame(const FrameTree& subtree) {
-    attachFrameSubtreeToTerminalFrame(subtree, subtree.getRootFrameId());
-    assert(isValid());
+  void removeNode(int id) {
+    assert(isNodeExist(id));
+    assert(!isDecisionNode(id));  // must remove the decision variable before removing the node
+    assert(isTerminalNode(id));   // must remove all children before removing the node
+    assert(!hasParentId(id));     // must be cut from its parent
+    removeTerminalId(getNode(id));
+    node_db.erase(id);
+    if (id == root_id) { root_id = -1; } // need to use setRootId() to update root_id after calling removeNode()
   }
 
-  void attachFrameSubtree(const FrameTree& subtree, int subtree_root_frame_id, const DecisionVariable& new_decision_variable,
-                          DecisionOption option_for_unique_child_in_original, DecisionOption option_for_unique_child_in_subtree);  // only when subtree_root_frame is not a terminal frame in this tree.    // TODO: not tested yet
+  void setDecisionVariable(int id, const DecisionVariable& decision_var) {
+    auto& node = getNode(id);
+    assert(!node.decision_variable.isExist());
+    assert(node.children.empty());   // must not have any children before adding the decision variable
+    node.decision_variable = decision_var;
+  }
+
+  void removeDecisionVariable(int id) {
+    auto& node = getNode(id);
+    assert(node.decision_variable.isExist());
+    assert(node.children.empty());   // must remove all children before removing the decision variable
+    node.decision_variable = DecisionVariable();
+  }
+
+  void addChildId(int id, const DecisionOption& option, int child_id) {
+    auto& node = getNode(id);
+    auto& child_node = getNode(child_id);
+    assert(option == DecisionVariable::NIL ? !node.decision_variable.isExist() : node.decision_variable.contains(option));
+    assert(!node.children.contains(option));
+    assert(child_node.parent_id < 0);
+    if (node.children.empty()) removeTerminalId(node);
+    node.children.set(option, child_id);
+    child_node.parent_id = id;
+    child_node.parent_option = option;
+  }
+
+  void addUniqueChildId(int id, int child_id) { addChildId(id, DecisionVariable::NIL, child_id); }
 
+  void removeChildId(int id, const DecisionOption& option, int child_id) {
+    auto& node = getNode(id);
+    auto& child_node = getNode(child_id);
+    assert(hasChildIdWithOption(id, option, child_id));
+    assert(child_node.parent_id == id);
+    node.children.erase(option);
+    if (node.children.empty()) addTerminalId(id, node);
+    child_node.parent_id = -1;
+    child_node.parent_option = DecisionVariable::NIL;
+  }
 
-  void deleteFrameSubtree(int frame_id);
+  void removeUniqueChildId(int id, int child_id) { removeChildId(id, DecisionVariable::NIL, child_id); }
 
-  void pop_front();
+  void attachSubtreeToTerminalNode(const ContingencyTree& subtree) {   // the root of subtree must be a terminal node in this tree
+    attachSubtreeToTerminalNode(subtree, subtree.getRootId());
+  }
 
+  void deleteSubtree(int id);
+
+  void pop_front();   // remove the root and detach all subtrees except the subtree of the default child
+
+  bool hasDiscardedNodes() const { return !discarded_ids.empty(); }
+  void reclaimDiscardedNodes();   // delete the subtrees detached by pop_front()
 
   bool isValid() const;
 
-  void print() const;
+protected:
 
-private:
+  void attachSubtreeToTerminalNode(const ContingencyTree& subtree, int subtree_root_id);   // subtree_root_id must be a terminal node in this tree
 
-  void attachFrameSubtreeToTerminalFrame(const FrameTree& subtree, int subtree_root_frame_id);   // only when subtree_root_frame is a terminal frame in this tree.    // TODO: not tested yet
+private:
 
-  bool isValid(int frame_id, std::vector<int>& visited_frame_ids) const;
+  bool isValid(int id, std::unordered_set<int>& visited_ids) const;   // check the subtree rooted at id
 
-  void print(int indent_size, int frame_id) const;
+  void getTerminalIds(std::vector<int>& terminal_ids, int id) const;   // in the subtree rooted at id
 
 };
 
 
+template<typename Payload>
+std::vector<int> ContingencyTree<Payload>::getNextTerminalIds() const {
+  assert(!empty() && !hasDiscardedNodes());
+  if (isTerminalNode(root_id)) return {};   // the tree will be empty
+  if (!isDecisionNode(root_id)) return { terminal_ids.begin(), terminal_ids.end() };
+  // only the terminal nodes under the non-default children of the root are removed
+  std::vector<int> removed_terminal_ids;
+  auto default_option = getDefaultOption(root_id);
+  for(auto [option, child_id] : getChildren(root_id)) {
+    if (option != default_option) getTerminalIds(removed_terminal_ids, child_id);
+  }
+  std::sort(removed_terminal_ids.begin(), removed_terminal_ids.end());
+  std::vector<int> next_terminal_ids;
+  next_terminal_ids.reserve(terminal_ids.size() - removed_terminal_ids.size());
+  for(auto id : terminal_ids) {
+    if (!std::binary_search(removed_terminal_ids.begin(), removed_terminal_ids.end(), id)) next_terminal_ids.push_back(id);
+  }
+  return next_terminal_ids;
+}
+
+
+template<typename Payload>
+void ContingencyTree<Payload>::getTerminalIds(std::vector<int>& terminal_ids, int id) const {
+  std::vector<int> stack = { id };
+  while(!stack.empty()) {
+    int node_id = stack.back();
+    stack.pop_back();
+    while(!isTerminalNode(node_id)) {   // follow the first child and come back for the others
+      int next_id = -1;
+      for(auto [option, child_id] : getChildren(node_id)) {
+        if (next_id < 0) next_id = child_id; else stack.push_back(child_id);
+      }
+      node_id = next_id;
+    }
+    terminal_ids.push_back(node_id);
+  }
+}
+
+
+template<typename Payload>
+void ContingencyTree<Payload>::attachSubtreeToTerminalNode(const ContingencyTree& subtree, int subtree_root_id) {
+  assert(!subtree.empty());
+  assert(isNodeExist(subtree_root_id));
+  assert(!isDecisionNode(subtree_root_id));
+  assert(isTerminalNode(subtree_root_id));  // must be terminal for this function
+
+  std::vector<int> stack = { subtree_root_id };   // the nodes that are copied but whose children are not
+  while(!stack.empty()) {
+    int id = stack.back();
+    stack.pop_back();
+    while(!subtree.isTerminalNode(id)) {   // follow the first child, so that a chain is copied in this loop
+      if (subtree.isDecisionNode(id)) {
+        setDecisionVariable(id, subtree.getDecisionVariable(id));
+      }
+      int next_id = -1;
+      for(auto [option, child_id] : subtree.getChildren(id)) {
+        assert(!isNodeExist(child_id));
+        addNode(subtree.getPayload(child_id));
+        addChildId(id, option, child_id);
+        if (next_id < 0) next_id = child_id; else stack.push_back(child_id);
+      }
+      id = next_id;
+    }
+  }
+}
+
+
+template<typename Payload>
+void ContingencyTree<Payload>::deleteSubtree(int id) {
+  assert(isNodeExist(id));
+  if (root_id == id) {   // delete everything
+    clear();
+    return;
+  }
+  if (hasParentId(id)) {
+    removeChildId(getParentId(id), getParentOption(id), id);
+  }
+  // the links inside the subtree go away with the nodes, so only the frontier needs to be updated
+  std::vector<int> stack = { id };
+  while(!stack.empty()) {
+    int node_id = stack.back();
+    stack.pop_back();
+    while(node_id >= 0) {   // follow the first child, so that a chain is deleted in this loop
+      auto iter = node_db.find(node_id);
+      assert(iter != node_db.end());
+      auto& node = iter->second;
+      int next_id = -1;
+      for(auto [option, child_id] : node.children) {
+        if (next_id < 0) next_id = child_id; else stack.push_back(child_id);
+      }
+      if (node.terminal_index >= 0) removeTerminalId(node);
+      node_db.erase(iter);
+      node_id = next_id;
+    }
+  }
+}
+
+
+template<typename Payload>
+void ContingencyTree<Payload>::pop_front() {
+  assert(!empty());
+  if (isTerminalNode(root_id)) {
+    clear(); // just remove everything
+    return;
+  }
+  int next_root_id = isDecisionNode(root_id) ? getDefaultChildId(root_id) : getUniqueChildId(root_id);
+  auto children = getChildren(root_id);
+  for(auto [option, child_id] : children) {
+    removeChildId(root_id, option, child_id);   // cut ties with the next node and the discarded subtrees
+    if (child_id != next_root_id) {
+      discarded_ids.push_back(child_id);
+    }
+  }
+  if (isDecisionNode(root_id)) {
+    removeDecisionVariable(root_id);
+  }
+  removeNode(root_id);
+  setRootId(next_root_id);
+}
+
+
+template<typename Payload>
+void ContingencyTree<Payload>::reclaimDiscardedNodes() {
+  for(auto id : discarded_ids) {
+    deleteSubtree(id);
+  }
+  discarded_ids.clear();
+}
+
+
+template<typename Payload>
+bool ContingencyTree<Payload>::isValid() const {
+  if (empty()) return root_id == -1;
+  std::unordered_set<int> visited_ids;
+  if (hasParentId(root_id) || !isValid(root_id, visited_ids)) return false;
+  for(auto id : discarded_ids) {
+    if (hasParentId(id) || !isValid(id, visited_ids)) return false;
+  }
+  if (static_cast<std::size_t>(size()) != visited_ids.size()) return false;
+  int terminal_num = 0;
+  for(auto& [id, node] : node_db) {
+    if (node.children.empty()) {
+      if (node.terminal_index < 0 || node.terminal_index >= static_cast<int>(terminal_ids.size()) || terminal_ids[node.terminal_index] != id) return false;
+      terminal_num++;
+    } else if (node.terminal_index >= 0) {
+      return false;
+    }
+  }
+  return terminal_num == static_cast<int>(terminal_ids.size());
+}
+
+
+template<typename Payload>
+bool ContingencyTree<Payload>::isValid(int id, std::unordered_set<int>& visited_ids) const {
+  std::vector<int> stack = { id };
+  while(!stack.empty()) {
+    int node_id = stack.back();
+    stack.pop_back();
+
+    auto node = findNode(node_id);
+    if (node == nullptr) return false;
+    if (!visited_ids.insert(node_id).second) return false; // should not visit again
+
+    if (node->parent_id >= 0) {
+      auto parent_node = findNode(node->parent_id);
+      if (parent_node == nullptr) return false;
+      if (!parent_node->children.contains(node->parent_option) || parent_node->children.at(node->parent_option) != node_id) return false;
+    }
+
+    if (node->decision_variable.isExist()) {
+      for(auto [option, child_id] : node->children) {
+        if (option == DecisionVariable::NIL) return false;
+        if (!node->decision_variable.contains(option)) return false;
+        stack.push_back(child_id);
+      }
+    } else if (!node->children.empty()) {
+      if (node->children.size() != 1) return false;
+      if (!node->children.contains(DecisionVariable::NIL)) return false;
+      stack.push_back(node->children.at(DecisionVariable::NIL));
+    } // else terminal node, no need to test
+  }
+  return true;
+}
+
+
 // -------------------------------------------------------------------------------------------
 //   Formation
 // -------------------------------------------------------------------------------------------
 
+// A formation is a persistent vector of drone states stored in fixed-size chunks. Copying a
+// formation shares all chunks with the original, and a chunk is copied only when a drone state
+// in it is about to change while the chunk is still shared. A child formation plan therefore
+// shares the unchanged drone blocks of its parent. Chunks are shared only between formations
+// that use the same memory resource, so that a formation never outlives the arena of its chunks.
+
 class Formation {
 
-  std::vector<DroneState> drone_state_db;
+  struct Chunk {
+    std::array<DroneState, FORMATION_CHUNK_SIZE> drone_states;
+  };
+
+  int drone_num = 0;
+  std::pmr::vector<std::shared_ptr<Chunk>> chunks;
 
 public:
 
+  using allocator_type = std::pmr::polymorphic_allocator<>;   // so that a formation in a pmr container draws from the same memory resource
+
+  using ChunkTranslation = std::unordered_map<const Chunk*, std::shared_ptr<Chunk>>;   // the copies of the chunks moved to another memory resource
+
   Formation() = default;
 
-  Formation(const Formation& formation) : drone_state_db(formation.drone_state_db) {}
+  explicit Formation(const allocator_type& alloc) : chunks(alloc) {}
 
-  void operator=(const Formation& formation2) { drone_state_db = formation2.drone_state_db; }
+  Formation(const Formation& formation) { copyChunks(formation); }
+  Formation(Formation&& formation) = default;
+  Formation(const Formation& formation, const allocator_type& alloc) : chunks(alloc) { copyChunks(formation); }
+  Formation(Formation&& formation, const allocator_type& alloc) : chunks(alloc) { *this = std::move(formation); }
+  Formation(const Formation& formation, ChunkTranslation& translation, const allocator_type& alloc);   // keep the sharing among the copies
+  Formation& operator=(const Formation& formation) { if (this != &formation) copyChunks(formation); return *this; }
+  Formation& operator=(Formation&& formation);
 
 
-  int size() const { return drone_state_db.size(); }
+  int size() const { return drone_num; }
 
-  DroneState& getDroneState(int drone_id) { return drone_state_db[drone_id]; }
-  const DroneState& getDroneState(int drone_id) const { return drone_state_db[drone_id]; }
-  const std::vector<DroneState>& getDroneStates() const { return drone_state_db; }
+  const DroneState& getDroneState(int drone_id) const {
+    assert(0 <= drone_id && drone_id < drone_num);
+    return chunks[drone_id / FORMATION_CHUNK_SIZE]->drone_states[drone_id % FORMATION_CHUNK_SIZE];
+  }
 
-  const Frame makeFrame() const {
-    Frame frame;
-    for(auto& drone_state : drone_state_db) {
-      frame.addPixel(drone_state.getPixel());
-    }
-    return frame;
+  DroneState& getDroneState(int drone_id) {   // copy the chunk first if it is shared
+    assert(0 <= drone_id && drone_id < drone_num);
+    return getUniqueChunk(drone_id / FORMATION_CHUNK_SIZE).drone_states[drone_id % FORMATION_CHUNK_SIZE];
   }
 
-  void clear() { drone_state_db.clear(); }
+  void setDroneState(int drone_id, const Pos3D& pos, const Color3D& color);   // do not copy the chunk if the state is unchanged
 
-  void addDroneState(double x, double y, double z) {
-    drone_state_db.emplace_back(x, y, z);
+  Frame makeFrame() const {
+    FrameBuilder builder;
+    builder.reserve(drone_num);
+    for(int drone_id = 0; drone_id < drone_num; drone_id++) {
+      builder.addPixel(getDroneState(drone_id).getPixel());
+    }
+    return builder.build();
   }
 
-  void addDroneState(double x, double y, double z, const Color3D& color) {
-    drone_state_db.emplace_back(x, y, z, color);
-  }
+  void clear() { drone_num = 0; chunks.clear(); }
 
-  void addDroneState(const Pixel& pixel) {
-    drone_state_db.emplace_back(pixel);
-  }
+  void swapDroneStates(int drone_id1, int drone_id2) { std::swap(getDroneState(drone_id1), getDroneState(drone_id2)); }
+
+  void addDroneState(double x, double y, double z) { addDroneState(DroneState(x, y, z)); }
+
+  void addDroneState(double x, double y, double z, const Color3D& color) { addDroneState(DroneState(x, y, z, color)); }
+
+  void addDroneState(const Pixel& pixel) { addDroneState(DroneState(pixel)); }
+
+  void addDroneState(const DroneState& drone_state);
+
+private:
+
+  std::pmr::memory_resource* getResource() const { return chunks.get_allocator().resource(); }
+
+  Chunk& getUniqueChunk(int chunk_id);
+
+  void copyChunks(const Formation& formation);   // share the chunks if possible
 
 };
 
@@ -571,7 +1091,7 @@ public:
 class FormationPlan {
 
   Formation formation1;
-  std::vector<Formation> micro_formation_seq;  // excluding formation1
+  std::pmr::vector<Formation> micro_formation_seq;  // excluding formation1
 
   int frame1_id;
   int frame2_id;
@@ -579,11 +1099,34 @@ class FormationPlan {
   DroneAssignment assignment1; // duplicated from the parent formation plan
   DroneAssignment assignment2;
 
+  // hidden_since_depths[drone_id] is the search depth of frame1 of the earliest formation plan in the
+  // chain of ancestor plans (ending at this plan) in which drone_id is never assigned to a pixel in
+  // frame2, or -1 if drone_id is assigned in assignment2. It is derived from the parent plan.
+  std::vector<std::int16_t> hidden_since_depths;
+
 public:
 
+  using allocator_type = std::pmr::polymorphic_allocator<>;   // the formations are allocated from this memory resource
+
   FormationPlan() : frame1_id(-1), frame2_id(-1) {}
 
-  FormationPlan(int frame1_id, int frame2_id) : frame1_id{frame1_id}, frame2_id{frame2_id} {}
+  FormationPlan(int frame1_id, int frame2_id, const allocator_type& alloc = {}) :
+      formation1(alloc), micro_formation_seq(alloc), frame1_id{frame1_id}, frame2_id{frame2_id} {}
+
+  FormationPlan(const FormationPlan& plan) = default;
+  FormationPlan(FormationPlan&& plan) = default;
+  FormationPlan& operator=(const FormationPlan& plan) = default;
+  FormationPlan& operator=(FormationPlan&& plan) = default;
+
+  FormationPlan(const FormationPlan& plan, const allocator_type& alloc) :
+      formation1(plan.formation1, alloc), micro_formation_seq(plan.micro_formation_seq, alloc), frame1_id{plan.frame1_id}, frame2_id{plan.frame2_id},
+      assignment1(plan.assignment1), assignment2(plan.assignment2), hidden_since_depths(plan.hidden_since_depths) {}
+
+  FormationPlan(FormationPlan&& plan, const allocator_type& alloc) :
+      formation1(std::move(plan.formation1), alloc), micro_formation_seq(std::move(plan.micro_formation_seq), alloc), frame1_id{plan.frame1_id}, frame2_id{plan.frame2_id},
+      assignment1(std::move(plan.assignment1)), assignment2(std::move(plan.assignment2)), hidden_since_depths(std::move(plan.hidden_since_depths)) {}
+
+  FormationPlan(const FormationPlan& plan, Formation::ChunkTranslation& translation, const allocator_type& alloc);
 
   bool isNil() const { frame1_id == -1 && frame2_id == -1; }
 
@@ -591,6 +1134,7 @@ public:
   bool empty() const { return micro_formation_seq.empty(); }
 
   const Formation& getFormation1() const { return formation1; }
+  Formation& getFormation1() { return formation1; }
   const Formation& getFormation2() const { return micro_formation_seq.back(); }
 
   Formation& getMicroFormation(int formation_id) { return micro_formation_seq[formation_id]; }
@@ -599,6 +1143,7 @@ public:
   int getFrame1Id() const { return frame1_id; }
   int getFrame2Id() const { return frame2_id; }
   const DroneAssignment& getAssignment1() const { return assignment1; }
+  DroneAssignment& getAssignment1() { return assignment1; }
   const DroneAssignment& getAssignment2() const { return assignment2; }
   DroneAssignment& getAssignment2() { return assignment2; }
 
@@ -606,6 +1151,15 @@ public:
   void setFormation1(const Formation& formation1) { FormationPlan::formation1 = formation1; }
   void setAssignment1(const DroneAssignment& assignment1) { FormationPlan::assignment1 = assignment1; }
   void setAssignment2(const DroneAssignment& assignment2) { FormationPlan::assignment2 = assignment2; }
+  void setAssignment2(DroneAssignment&& assignment2) { FormationPlan::assignment2 = std::move(assignment2); }
+
+  const std::vector<std::int16_t>& getHiddenSinceDepths() const { return hidden_since_depths; }
+  int getHiddenSinceDepth(int drone_id) const { return hidden_since_depths[drone_id]; }
+  void setHiddenSinceDepth(int drone_id, int depth) { hidden_since_depths[drone_id] = static_cast<std::int16_t>(depth); }
+  void setHiddenSinceDepths(const std::vector<std::int16_t>& hidden_since_depths) { FormationPlan::hidden_since_depths = hidden_since_depths; }
+  void setHiddenSinceDepths(std::vector<std::int16_t>&& hidden_since_depths) { FormationPlan::hidden_since_depths = std::move(hidden_since_depths); }
+
+  void swapDroneIds(int drone_id1, int drone_id2, bool is_swap_formation1, int first_micro_frame_id = 0);  // exchange the roles of two drones in this plan from first_micro_frame_id on
 
   friend std::ostream& operator<<(std::ostream& out, const FormationPlan& formation_plan) {
     out << "FormationPlan {micro_formation_seq.size()=" << formation_plan.micro_formation_seq.size() << "}";
@@ -615,28 +1169,145 @@ public:
 };
 
 
+// -------------------------------------------------------------------------------------------
+//   Formation Plan Cache
+// -------------------------------------------------------------------------------------------
+
+// A bounded LRU cache of the solutions of the hopping subproblems, i.e., of which hidden drones
+// take the new pixels of frame2. The persistent pixels keep their drones anyway, so the key is a
+// fingerprint of the positions of the new pixels only, quantized to cells of
+// FORMATION_PLAN_CACHE_QUANTUM, and recurs whenever the same objects show up in the same place.
+// An entry holds the positions of the drones that took the new pixels. The hidden drones keep
+// moving, so an entry is not replayed by drone id: each new pixel takes the free candidate drone
+// nearest to the cached position within the same cell, or one in the cell of the pixel that is
+// available earlier (see SpicompPlanner::adaptCachedHops()). Thus a lookup is a hit as long as the candidate drones
+// stay in their cells, and a miss as soon as both cells of a new pixel run out of candidates. The micro formations are always recomputed from the
+// actual incoming formation. A cache of capacity 0 is disabled.
+
+class FormationPlanCache {
+
+  using Entry = std::pair<std::size_t, std::vector<Pos3D>>;
+
+  int capacity;
+  std::list<Entry> entry_list;   // the most recently used entry is at the front
+  std::unordered_map<std::size_t, std::list<Entry>::iterator> entry_db;
+
+  int hit_count;
+  int miss_count;
+
+public:
+
+  explicit FormationPlanCache(int capacity = FORMATION_PLAN_CACHE_CAPACITY) : capacity{capacity}, hit_count{0}, miss_count{0} {
+    assert(capacity >= 0);
+  }
+
+  int size() const { return entry_db.size(); }
+  int getCapacity() const { return capacity; }
+  bool isEnabled() const { return capacity > 0; }
+
+  void clear() {
+    entry_list.clear();
+    entry_db.clear();
+    hit_count = 0;
+    miss_count = 0;
+  }
+
+  int getHitCount() const { return hit_count; }
+  int getMissCount() const { return miss_count; }
+  double getHitRate() const { return (hit_count + miss_count > 0) ? (static_cast<double>(hit_count) / (hit_count + miss_count)) : 0.0; }
+
+  const std::vector<Pos3D>* find(std::size_t fingerprint);   // the drone positions of the new pixels, or nullptr if not found
+
+  void recordLookup(bool is_hit) { if (is_hit) hit_count++; else miss_count++; }
+
+  void insert(std::size_t fingerprint, std::vector<Pos3D> drone_positions);
+
+  static std::size_t makeFingerprint(const Frame& frame2, const DroneAssignment& partial_assignment2);   // the new pixels are the unassigned ones
+
+  static std::size_t makeCellKey(const Pos3D& pos);   // the quantization cell of pos
+
+};
+
+
 // -------------------------------------------------------------------------------------------
 //   Game State
 // -------------------------------------------------------------------------------------------
 
 
+struct Bullet {
+  int id = -1;  // the id of the game state that fires the bullet
+  Pos3D pos;
+};
+
+
+// The bullets in flight, oldest first, in a fixed-capacity ring that is stored inline, so that
+// copying a game state or advancing its bullets does not allocate. All bullets are fired at the
+// same height and move at the same speed, so the oldest bullet is the first to go out of range.
+
+class BulletRing {
+
+  std::array<Bullet, MAX_BULLET_NUM> bullets;
+  int first;
+  int bullet_num;
+
+public:
+
+  BulletRing() : first{0}, bullet_num{0} {}
+
+  int size() const { return bullet_num; }
+  bool empty() const { return bullet_num == 0; }
+  const Bullet& operator[](int i) const { assert(0 <= i && i < bullet_num); return bullets[(first + i) % MAX_BULLET_NUM]; }
+
+  void push_back(const Bullet& bullet) {
+    assert(bullet_num < MAX_BULLET_NUM);
+    bullets[(first + bullet_num) % MAX_BULLET_NUM] = bullet;
+    bullet_num++;
+  }
+
+  void advance() {   // move all bullets up and drop the ones that go out of range
+    while(bullet_num > 0 && bullets[first].pos.z + BULLET_JUMP_DISTANCE > BULLET_MAX_DISTANCE) {
+      first = (first + 1) % MAX_BULLET_NUM;
+      bullet_num--;
+    }
+    for(int i = 0; i < bullet_num; i++) {
+      auto& bullet = bullets[(first + i) % MAX_BULLET_NUM];
+      assert(bullet.pos.z + BULLET_JUMP_DISTANCE <= BULLET_MAX_DISTANCE);
+      bullet.pos.translate(0.0, 0.0, BULLET_JUMP_DISTANCE);
+    }
+  }
+
+};
+
+
+// The gun moves along gun_trajectory and cycles through the power levels, independently of the
+// decisions, so its state machine is compiled into gun_state_table. An entry holds the next gun
+// state, the start position of a bullet fired in the transition, and the gun pixels of the state
+// as a template block for makeFrame().
+
 class GameState {
 
+  struct GunState {
+    int next_gun_state_id;
+    bool is_decision;          // whether the player decides to fire in the transition
+    Pos3D new_bullet_pos;      // the position of a bullet fired in the transition
+    Frame frame;               // the gun pixels, with their identities
+  };
+
   static const std::vector<Pos3D> gun_trajectory;
+  static const std::vector<GunState> gun_state_table;   // indexed by getGunStateId()
 
   int id;
-  int pos_id;
-  int power_level_id;
-  std::vector<Pos3D> bullet_pos_list;
+  int gun_state_id;
+  BulletRing bullets;
 
 public:
 
-  GameState() : id{-1}, pos_id{-1}, power_level_id{-1} { }
+  GameState() : id{-1}, gun_state_id{-1} { }
 
-  GameState(int& id) : GameState(id, 0, 0, {}) { } // no need to increase id by 1
+  GameState(int& id) : GameState(id, getGunStateId(0, 0), {}) { } // no need to increase id by 1
 
-  GameState(int& id, int pos_id, int power_level_id, const std::vector<Pos3D>& bullet_pos_list) :
-      id{id}, pos_id{pos_id}, power_level_id{power_level_id}, bullet_pos_list{bullet_pos_list}
+  GameState(int& id, int gun_state_id, const BulletRing& bullets) :
+      id{id}, gun_state_id{gun_state_id}, bullets{bullets}
   {
     id++;
   }
@@ -644,7 +1315,7 @@ public:
   int getId() const { return id; }
 
   bool isDecisionGameState() const {
-    return power_level_id == 2;
+    return gun_state_table[gun_state_id].is_decision;
   }
 
   DecisionVariable getDecisionVariable(int& next_decision_variable_id) const {
@@ -656,213 +1327,156 @@ public:
     return v;
   }
 
-  [[nodiscard]] std::unordered_map<DecisionOption,GameState> getNextGameStates(const DecisionVariable& decision_variable, int& next_id) const {
+  [[nodiscard]] std::array<std::pair<DecisionOption, GameState>, 2> getNextGameStates(const DecisionVariable& decision_variable, int& next_id) const {
     assert(isDecisionGameState());
+    auto& gun_state = gun_state_table[gun_state_id];
 
-    int next_pos_id = pos_id + 1;
-    if (next_pos_id >= gun_trajectory.size()) { next_pos_id = 0; }
-
-    int next_power_level_id = power_level_id + 1;
-    if (next_power_level_id >= 4) { next_power_level_id = 0; }
+    auto next_bullets0 = bullets;
+    next_bullets0.advance();
+    auto next_bullets1 = next_bullets0;
+    next_bullets1.push_back(Bullet{id, gun_state.new_bullet_pos});
 
-    auto next_bullet_pos_list0 = advanceBullets(bullet_pos_list);
-    auto new_bullet_pos = gun_trajectory[next_pos_id];
-    new_bullet_pos.translate(50.0, 50.0, 125.0);
-    auto next_bullet_pos_list1 = addNewBullet(next_bullet_pos_list0, new_bullet_pos);
+    GameState state0(next_id, gun_state.next_gun_state_id, next_bullets0);
+    GameState state1(next_id, gun_state.next_gun_state_id, next_bullets1);
 
-    GameState state0(next_id, next_pos_id, next_power_level_id, next_bullet_pos_list0);
-    GameState state1(next_id, next_pos_id, next_power_level_id, next_bullet_pos_list1);
-
-    return { {0, state0}, {1, state1}};
+    return { { {0, state0}, {1, state1} } };
   }
 
   GameState getUniqueNextGameState(int& next_id) const {    // when isDecisionGameState is false
     assert(!isDecisionGameState());
 
-    int next_pos_id = pos_id + 1;
-    if (next_pos_id >= gun_trajectory.size()) { next_pos_id = 0; }
-
-    int next_power_level_id = power_level_id + 1;
-    if (next_power_level_id >= 4) { next_power_level_id = 0; }
-
-    GameState state(next_id, next_pos_id, next_power_level_id, advanceBullets(bullet_pos_list));
+    auto next_bullets = bullets;
+    next_bullets.advance();
 
-    return state;
+    return GameState(next_id, gun_state_table[gun_state_id].next_gun_state_id, next_bullets);
   }
 
 
+  // The identity of a gun pixel is its index, and the identities of the two pixels of a bullet are
+  // derived from the id of the game state that fires the bullet. Hence, a pixel keeps its identity
+  // in all the frames in which it persists.
   Frame makeFrame() const {
-
-    std::vector<Pixel> gun_pixels;
-
-    auto gun_color = COLOR_GREEN;
-    auto power_color = COLOR_RED;
-
-    std::vector<Color3D> gun_colors(3, gun_color);
-    if (power_level_id < 3) {
-      gun_colors[power_level_id] = power_color;
+    auto& gun_frame = gun_state_table[gun_state_id].frame;
+    int gun_pixel_num = gun_frame.size();
+
+    FrameBuilder builder;
+    builder.reserve(gun_pixel_num + 2 * bullets.size());
+    builder.addPixels(gun_frame);
+
+    for(int i = 0; i < bullets.size(); i++) {
+      auto& bullet = bullets[i];
+      Pixel bullet_pixel_down(bullet.pos.x, bullet.pos.y, bullet.pos.z - BULLET_JUMP_DISTANCE / 4.0, COLOR_ORANGE_RED);
+      builder.addPixel(bullet_pixel_down, gun_pixel_num + 2 * bullet.id);
+      Pixel bullet_pixel_up(bullet.pos.x, bullet.pos.y, bullet.pos.z + BULLET_JUMP_DISTANCE / 4.0, COLOR_ORANGE_RED);
+      builder.addPixel(bullet_pixel_up, gun_pixel_num + 2 * bullet.id + 1);
     }
 
-    gun_pixels.emplace_back(  0.0,   0.0,  0.0, gun_colors[0]);
-    gun_pixels.emplace_back( 50.0,   0.0,  0.0, gun_colors[0]);
-    gun_pixels.emplace_back(100.0,   0.0,  0.0, gun_colors[0]);
-    gun_pixels.emplace_back(  0.0,  50.0,  0.0, gun_colors[0]);
-    gun_pixels.emplace_back(  0.0, 100.0,  0.0, gun_colors[0]);
-    gun_pixels.emplace_back( 50.0, 100.0,  0.0, gun_colors[0]);
-    gun_pixels.emplace_back(100.0,  50.0,  0.0, gun_colors[0]);
-    gun_pixels.emplace_back(100.0, 100.0,  0.0, gun_colors[0]);
-
-    gun_pixels.emplace_back( 25.0,  25.0, 50.0, gun_colors[1]);
-    gun_pixels.emplace_back( 75.0,  25.0, 50.0, gun_colors[1]);
-    gun_pixels.emplace_back( 25.0,  75.0, 50.0, gun_colors[1]);
-    gun_pixels.emplace_back( 75.0,  75.0, 50.0, gun_colors[1]);
-
-    gun_pixels.emplace_back( 50.0,  50.0, 100.0, gun_colors[2]);
-
-    for(auto& pixel : gun_pixels) {
-      pixel.translate(gun_trajectory[pos_id]);
-    }
-
-    Frame frame;
-    frame.setId(id);  // make frame_id equal to game_state_id
-
-    for(auto& pixel : gun_pixels) {
-      frame.addPixel(pixel);
-    }
-
-    for(auto& bullet_pos : bullet_pos_list) {
-//      Pixel bullet_pixel(bullet_pos, COLOR_ORANGE_RED);
-//      frame.addPixel(bullet_pixel);
-
-      auto bullet_pos_down = bullet_pos;
-      bullet_pos_down.translate(0.0, 0.0, -BULLET_JUMP_DISTANCE / 4.0);
-      Pixel bullet_pixel_down(bullet_pos_down, COLOR_ORANGE_RED);
-      frame.addPixel(bullet_pixel_down);
-
-      auto bullet_pos_up = bullet_pos;
-      bullet_pos_up.translate(0.0, 0.0, BULLET_JUMP_DISTANCE / 4.0);
-      Pixel bullet_pixel_up(bullet_pos_up, COLOR_ORANGE_RED);
-      frame.addPixel(bullet_pixel_up);
-    }
-
-    return frame;
+    return builder.build(id);  // make frame_id equal to game_state_id
   }
 
 private:
 
-  static std::vector<Pos3D> advanceBullets(const std::vector<Pos3D>& bullet_pos_list) {
-    std::vector<Pos3D> next_bullet_pos_list;
-    for(auto& bullet_pos : bullet_pos_list) {
-      if (bullet_pos.z + BULLET_JUMP_DISTANCE <= BULLET_MAX_DISTANCE) {
-        next_bullet_pos_list.push_back(bullet_pos);
-        next_bullet_pos_list.back().translate(0.0, 0.0, BULLET_JUMP_DISTANCE);
-      }  // else drop this bullet
-    }
-    return next_bullet_pos_list;
-  }
-
-  static std::vector<Pos3D> addNewBullet(const std::vector<Pos3D>& bullet_pos_list, Pos3D bullet_pos) {
-    std::vector<Pos3D> next_bullet_pos_list = bullet_pos_list;
-    next_bullet_pos_list.push_back(bullet_pos);
-    return next_bullet_pos_list;
-  }
+  static int getGunStateId(int pos_id, int power_level_id) { return pos_id * POWER_LEVEL_NUM + power_level_id; }
 
+  static std::vector<GunState> makeGunStateTable();
 
 };
 
 
 // -------------------------------------------------------------------------------------------
-//   Game State
+//   The Frame Tree
 // -------------------------------------------------------------------------------------------
 
+// A node of the frame tree holds a frame together with the game state that it shows, so that the
+// game controller and the planner work on one tree and every insertion and pop_front() is done
+// once. The frame is a handle to immutable pixels, so it is copied out of a node or replaced
+// without touching the game state. In a frame tree that is not grown from a game (e.g., in the
+// tests), the game state has id -1.
+
+struct GameFrame {
+  Frame frame;
+  GameState game_state;
 
-class GameStateTree {
+  int getId() const { return frame.getId(); }
+};
 
-  int root_game_state_id;
-  std::unordered_map<int, GameState> game_state_db;
-  std::unordered_map<int, DecisionVariable> decision_variable;
-  std::unordered_map<int, std::unordered_map<DecisionOption,int>> children_ids;
+
+class FrameTree : public ContingencyTree<GameFrame> {
 
 public:
 
-  GameStateTree() : root_game_state_id(-1) {}
+  // --- Query ---
 
-  bool empty() const { return root_game_state_id == -1; }
-  void clear() { root_game_state_id = -1; game_state_db.clear(); decision_variable.clear(); children_ids.clear(); }
-  int size() const { return game_state_db.size(); }
+  int getRootFrameId() const { return getRootId(); }
+  const Frame& getRootFrame() const { return getRoot().frame; }
 
-  int getRootGameStateId() const { return root_game_state_id; }
-  const GameState& getRootGameState() const { return game_state_db.at(root_game_state_id); }
+  bool isFrameExist(int frame_id) const { return isNodeExist(frame_id); }
+  const Frame& getFrame(int frame_id) const { return getPayload(frame_id).frame; }
+  const GameState& getGameState(int frame_id) const { return getPayload(frame_id).game_state; }
 
-  bool isGameStateExist(int game_state_id) const { return game_state_db.contains(game_state_id); }
-  const GameState& getGameState(int game_state_id) const { return game_state_db.at(game_state_id); }
-  const std::unordered_map<int, GameState>& getAllGameStates() const { return game_state_db; }
+  bool isDecisionFrame(int frame_id) const { return isDecisionNode(frame_id); }
 
-  bool isDecisionGameState(int game_state_id) const { return decision_variable.contains(game_state_id); }
-  const DecisionVariable& getDecisionVariable(int game_state_id) const { return decision_variable.at(game_state_id); }
+  bool isTerminalFrame(int frame_id) const { return isTerminalNode(frame_id); }
+  bool hasChildNilOption(int frame_id) const { return hasChildOption(frame_id, DecisionVariable::NIL); }
+  bool hasChildFrameId(int frame_id, int child_id) const { return hasChildId(frame_id, child_id); }
+  bool hasChildFrameIdWithOption(int frame_id, const DecisionOption& option, int child_id) const { return hasChildIdWithOption(frame_id, option, child_id); }
+  bool hasChildFrameIdWithoutOption(int frame_id, int child_id) const { return hasChildIdWithOption(frame_id, DecisionVariable::NIL, child_id); }
 
-  bool isTerminalGameState(int game_state_id) const { return !children_ids.contains(game_state_id); }
+  int getChildFrameId(int frame_id, const DecisionOption& option) const { return getChildId(frame_id, option); }
+  int getUniqueChildFrameId(int frame_id) const { return getUniqueChildId(frame_id); }
+  int getDefaultChildFrameId(int frame_id) const { return getDefaultChildId(frame_id); }
+  const Frame& getChildFrame(int frame_id, const DecisionOption& option) const { return getFrame(getChildFrameId(frame_id, option)); }
+  const Frame& getUniqueChildFrame(int frame_id) const { return getFrame(getUniqueChildFrameId(frame_id)); }
+  const Frame& getDefaultChildFrame(int frame_id) const { return getFrame(getDefaultChildFrameId(frame_id)); }
+  const DecisionChildren& getAllChildrenIdsWithOptions(int frame_id) const { return getChildren(frame_id); }
 
-  std::vector<int> getAllTerminalGameStateIds() const {
-    std::vector<int> terminal_game_state_ids;
-    getAllTerminalGameStateIds(terminal_game_state_ids, root_game_state_id);
-    return terminal_game_state_ids;
+  int getNextRootFrameId() const {   // the root frame after pop_front()
+    return isDecisionFrame(getRootId()) ? getDefaultChildFrameId(getRootId()) : getUniqueChildFrameId(getRootId());
   }
 
-  int getChildGameStateId(int game_state_id) const { return children_ids.at(game_state_id).at(DecisionVariable::NIL); }
-  int getChildGameStateId(int game_state_id, const DecisionOption& option) const { return children_ids.at(game_state_id).at(option); }
-  int getDefaultChildGameStateId(int game_state_id) const { return children_ids.at(game_state_id).at(getDecisionVariable(game_state_id).getDefaultOption()); }
+  bool hasParentFrameId(int frame_id) const { return hasParentId(frame_id); }
+  int getParentFrameId(int frame_id) const { return getParentId(frame_id); }
 
-  const GameState& getChildGameState(int game_state_id) const { return getGameState(getChildGameStateId(game_state_id)); }
-  const GameState& getChildGameState(int game_state_id, const DecisionOption& option) const { return getGameState(getChildGameStateId(game_state_id, option)); }
-  const GameState& getDefaultChildGameState(int game_state_id) const { return getGameState(getDefaultChildGameStateId(game_state_id)); }
-
-  const std::unordered_map<DecisionOption,int>& getChildrenIds(int game_state_id) const { return children_ids.at(game_state_id); }
+  std::span<const int> getTerminalFrameIds() const { return getTerminalIds(); }
+  std::vector<int> getNextTerminalFrameIds() const { return getNextTerminalIds(); }   // the terminal frames after pop_front()
 
+  // --- Update ---
 
-  void setRootGameStateId(int game_state_id) { root_game_state_id = game_state_id; }
+  void setRootFrameId(int frame_id) { setRootId(frame_id); }
 
-  void addGameState(const GameState& game_state) {
-    game_state_db[game_state.getId()] = game_state;
+  void addFrame(const Frame& frame) { addNode(GameFrame{frame, GameState()}); }
+  void addFrame(Frame&& frame) { addNode(GameFrame{std::move(frame), GameState()}); }
+  void addGameFrame(const GameState& game_state, Frame&& frame) {   // frame must show game_state
+    assert(frame.getId() == game_state.getId());
+    addNode(GameFrame{std::move(frame), game_state});
   }
+  void removeFrame(int frame_id) { removeNode(frame_id); }
 
-  void setDecisionVariable(int game_state_id, const DecisionVariable& decision_var) {
-    assert(!decision_variable.contains(game_state_id));
-    decision_variable.insert( {game_state_id, decision_var} );
+  void attachFrameSubtreeToTerminalFrame(const FrameTree& subtree) {
+    attachSubtreeToTerminalNode(subtree);
+    assert(isValid());
   }
 
-  void removeDecisionVariable(int game_state_id) {
-    assert(decision_variable.contains(game_state_id));
-    decision_variable.erase(game_state_id);
-  }
+  void attachFrameSubtree(const FrameTree& subtree, int subtree_root_frame_id, const DecisionVariable& new_decision_variable,
+                          DecisionOption option_for_unique_child_in_original, DecisionOption option_for_unique_child_in_subtree);  // only when subtree_root_frame is not a terminal frame in this tree.    // TODO: not tested yet
 
-  void addChildrenId(int game_state_id, int child_id) {
-    assert(!decision_variable.contains(game_state_id));
-    children_ids[game_state_id][DecisionVariable::NIL] = child_id;
-  }
 
-  void addChildrenId(int game_state_id, const DecisionOption& option, int child_id) {
-    assert(decision_variable.contains(game_state_id));
-    assert(decision_variable.at(game_state_id).contains(option));
-    children_ids[game_state_id][option] = child_id;
+  void deleteFrameSubtree(int frame_id) { deleteSubtree(frame_id); }
+
+  bool hasDiscardedFrames() const { return hasDiscardedNodes(); }
+  void reclaimDiscardedFrames() { reclaimDiscardedNodes(); }
+
+  void pop_front() {
+    ContingencyTree::pop_front();
+    assert(isValid());
   }
 
-  void pop_front();
 
+  void print() const;
 
 private:
 
-  void deleteGameStateSubtree(int game_state_id);
-
-  void getAllTerminalGameStateIds(std::vector<int>& terminal_game_state_ids, int game_state_id) const {
-    if (isTerminalGameState(game_state_id)) {
-      terminal_game_state_ids.push_back(game_state_id);
-    } else {
-      for(auto [option, child_id] : getChildrenIds(game_state_id)) {
-        getAllTerminalGameStateIds(terminal_game_state_ids, child_id);
-      }
-    }
-  }
+  void printFrame(int indent_size, int frame_id) const;
 
 };
 
@@ -882,7 +1496,9 @@ class GameController {
 
   std::unordered_map<int,DecisionVariable> decision_variable_list;  // TODO: remove some of this over time
 
-  GameStateTree game_state_tree;
+  FrameTree frame_tree;   // the game states and the frames that show them
+
+  bool is_next_frontier_prepared;   // the frontier after the next frame boundary is in frame_tree already
 
 public:
 
@@ -894,187 +1510,286 @@ public:
     sim_step_count = 0;
     next_game_state_id = 0;
     next_decision_variable_id = 0;
-    game_state_tree = GameStateTree();
+    frame_tree.clear();
     GameState root_game_state(next_game_state_id);
-    game_state_tree.addGameState(root_game_state);
-    game_state_tree.setRootGameStateId(root_game_state.getId());
-    pixel_trajectory_tracking_num = game_state_tree.getRootGameState().makeFrame().size();
+    frame_tree.addGameFrame(root_game_state, root_game_state.makeFrame());
+    frame_tree.setRootFrameId(root_game_state.getId());
+    pixel_trajectory_tracking_num = frame_tree.getRootFrame().size();
+    is_next_frontier_prepared = false;
   }
 
   void nextStep() {
     sim_step_count++;
   }
 
-  int size() const { return game_state_tree.size(); }
+  int size() const { return frame_tree.size(); }
 
   int getPixelTrajectoryTrackingNum() const { return pixel_trajectory_tracking_num; }
 
-  FrameTree getInitFrameTree() {
-    FrameTree original_frame_tree;
-    makeFrameTree(original_frame_tree, game_state_tree.getRootGameStateId());
-    for(int i=0; i<INIT_FRAMETREE_LENGTH; i++) {
-      extendFrameTree(original_frame_tree);
-    }
-    return original_frame_tree;
-  }
+  const FrameTree& getFrameTree() const { return frame_tree; }
 
-  std::vector<FrameTree> getNewFrameTrees() {
-    if (sim_step_count % micro_frame_num == (micro_frame_num-1)) {
-      std::vector<FrameTree> frame_tree_list;
-      for(auto game_state_id : game_state_tree.getAllTerminalGameStateIds()) {
-        frame_tree_list.emplace_back();
-        auto& frame_tree = frame_tree_list.back();
-        makeFrameTree(frame_tree, game_state_id);
-      }
-      return frame_tree_list;
-    } else {
-      return {};
-    }
+  void growInitFrameTree();   // expand the root game state by INIT_FRAMETREE_LENGTH + 1 levels
+
+  // Expand the terminal frames that will remain after the next removeFirstFrame(). Since the next
+  // game states are deterministic, this can be done ahead of the frame boundary, and the subtree
+  // of getNextRootFrameId() can be planned before the boundary.
+  void prepareNextFrontier() {
+    if (is_next_frontier_prepared) return;
+    frame_tree.reclaimDiscardedFrames();
+    expandFrontier(frame_tree.getNextTerminalFrameIds());
+    is_next_frontier_prepared = true;
   }
 
-  void removeFirstGameState() {
+  bool isNextFrontierPrepared() const { return is_next_frontier_prepared; }
+
+  int getNextRootFrameId() const { return frame_tree.getNextRootFrameId(); }
+
+  // Remove the root frame at a frame boundary and expand the frontier by one level, unless
+  // prepareNextFrontier() has done it already.
+  void removeFirstFrame() {
     assert(sim_step_count % micro_frame_num == (micro_frame_num-1));
-    game_state_tree.pop_front();
+    frame_tree.reclaimDiscardedFrames();   // in case no idle tick has reclaimed the previous ones
+    frame_tree.pop_front();
+    if (is_next_frontier_prepared) {
+      is_next_frontier_prepared = false;
+      return;
+    }
+    frame_tree.reclaimDiscardedFrames();   // the frontier must not contain the discarded frames
+    expandFrontier(frame_tree.getTerminalFrameIds());
   }
 
+  bool hasDiscardedFrames() const { return frame_tree.hasDiscardedFrames(); }
+  void reclaimDiscardedFrames() { frame_tree.reclaimDiscardedFrames(); }   // run in idle ticks
+
 private:
 
-  void makeFrameTree(FrameTree& frame_tree, int game_state_id) {
-    assert(game_state_tree.isTerminalGameState(game_state_id));
-
-    auto& game_state = game_state_tree.getGameState(game_state_id);
-    auto frame1 = game_state.makeFrame();
-    frame_tree.addFrame(frame1);
-
-    frame_tree.setRootFrameId(frame1.getId());
-
-    if (game_state.isDecisionGameState()) {
-      auto decision_variable = game_state.getDecisionVariable(next_decision_variable_id);
-      assert(decision_variable.getId() == next_decision_variable_id-1);
-      decision_variable_list.insert({ decision_variable.getId(), decision_variable });
-      game_state_tree.setDecisionVariable(game_state.getId(), decision_variable);
-      frame_tree.setDecisionVariable(frame1.getId(), decision_variable);
-      for(auto& [option, next_game_state] : game_state.getNextGameStates(decision_variable, next_game_state_id)) {
-        auto frame2 = next_game_state.makeFrame();
-        game_state_tree.addGameState(next_game_state);
-        frame_tree.addFrame(frame2);
-        game_state_tree.addChildrenId(game_state.getId(), option, next_game_state.getId());
-        frame_tree.addChildId(frame1.getId(), option, frame2.getId());
-      }
-    } else {
-      auto next_game_state = game_state.getUniqueNextGameState(next_game_state_id);
-      auto frame2 = next_game_state.makeFrame();
-      game_state_tree.addGameState(next_game_state);
-      frame_tree.addFrame(frame2);
-      game_state_tree.addChildrenId(game_state.getId(), next_game_state.getId());
-      frame_tree.addUniqueChildId(frame1.getId(), frame2.getId());
-    }
-  }
+  // The expansion of a terminal game state by one level. It is built from a pre-reserved range of
+  // game state ids and decision variable ids, so that the terminal states can be expanded
+  // independently of each other and merged into the frame tree afterwards.
+  struct GameStateExpansion {
+    int game_state_id;
+    DecisionVariable decision_variable;    // does not exist if the game state is not a decision game state
+    std::vector<std::pair<DecisionOption, GameState>> next_game_states;
+    std::vector<Frame> next_frames;        // the frames of next_game_states
+  };
 
-  void extendFrameTree(FrameTree& original_frame_tree) {
-    for(auto game_state_id : game_state_tree.getAllTerminalGameStateIds()) {
-      FrameTree frame_tree;
-      makeFrameTree(frame_tree, game_state_id);
-      original_frame_tree.attachFrameSubtreeToTerminalFrame(frame_tree);
-    }
-  }
+  void expandFrontier(std::span<const int> frame_ids);   // expand the terminal game states in parallel and merge them in bulk
+
+  GameStateExpansion expandGameState(int game_state_id, int first_game_state_id, int first_decision_variable_id) const;
+
+  void mergeGameStateExpansion(GameStateExpansion& expansion);
 
 };
 
 
 // -------------------------------------------------------------------------------------------
-//   The Frame Buffer
+//   Contingency Formation Plan
 // -------------------------------------------------------------------------------------------
 
-class FrameBuffer {
+// All formation plans of one replan are allocated from a monotonic arena owned by the plan, so
+// that building a plan is a sequence of pointer bumps and dropping a plan releases all of its
+// blocks at once. The storage is held by a pointer so that moving a plan never moves the arena.
+//
+// The arena grows in blocks of the same size, and emplaceFormationPlan() refuses a new plan once
+// the arena has reached the memory ceiling, so the memory of a plan stays below the ceiling plus
+// one block. The planner stops its search there (see SpicompPlanner::solve()).
+//
+// A plan that lives across several frame boundaries (e.g., when no replan happens, or after
+// repairs) is cleaned up by collectGarbage(): the plans whose frames have left the frame tree
+// are removed, and if the arena still holds more than the ceiling (the removed plans are not
+// freed until the arena is dropped), the remaining plans are compacted into a new arena of half
+// the ceiling, dropping the deepest and least likely branches first.
 
-  const int micro_frame_num;
-
-  int sim_step_count;
+class ContingencyFormationPlan {
 
-  FrameTree frame_tree;
+  class BlockArena : public std::pmr::memory_resource {   // a monotonic arena of blocks of CONTINGENCY_FORMATION_PLAN_ARENA_SIZE bytes
+    std::vector<std::pair<void*, std::size_t>> blocks;
+    void* next = nullptr;
+    std::size_t space = 0;   // the bytes after next in the current block
+    std::size_t size = 0;    // the bytes that the arena takes from the heap
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+      if (std::align(alignment, bytes, next, space) == nullptr) {   // a request larger than a block gets a block of its own
+        std::size_t block_size = std::max<std::size_t>(CONTINGENCY_FORMATION_PLAN_ARENA_SIZE, bytes + alignment);
+        next = ::operator new(block_size);
+        space = block_size;
+        blocks.emplace_back(next, block_size);
+        size += block_size;
+        std::align(alignment, bytes, next, space);
+      }
+      void* p = next;
+      next = static_cast<std::byte*>(next) + bytes;
+      space -= bytes;
+      return p;
+    }
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+  public:
+    BlockArena() = default;
+    BlockArena(const BlockArena&) = delete;
+    BlockArena& operator=(const BlockArena&) = delete;
+    ~BlockArena() override {
+      for(auto [block, block_size] : blocks) ::operator delete(block, block_size);
+    }
+    std::size_t getSize() const { return size; }
+    std::size_t getUsedSize() const { return size - space; }   // the bytes before next
+  };
+
+  // Since every edge of a tree is identified by its child frame, a plan is keyed by frame2_id.
+  // Frame ids are consecutive, so slot_ids is a dense index over the ids from first_frame2_id.
+  // The plans live in a deque so that adding a plan never moves the others; the slots of
+  // removed plans are recycled.
+  struct Storage {
+    BlockArena arena;
+    int first_frame2_id = 0;
+    std::pmr::vector<int> slot_ids{&arena};     // slot_ids[frame2_id - first_frame2_id] is the slot of the plan, or -1
+    std::pmr::deque<FormationPlan> formation_plans{&arena};
+    std::pmr::vector<int> free_slot_ids{&arena};
+    int plan_num = 0;
+  };
+
+  std::unique_ptr<Storage> storage;
+  std::size_t max_memory_size;   // the memory ceiling
 
 public:
 
-  FrameBuffer(int micro_frame_num) : micro_frame_num{micro_frame_num}, sim_step_count{0} { reset(); }
+  explicit ContingencyFormationPlan(std::size_t max_memory_size = CONTINGENCY_FORMATION_PLAN_MAX_MEMORY_SIZE) :
+      storage{std::make_unique<Storage>()}, max_memory_size{max_memory_size} {}
 
-  void reset() {
-    sim_step_count = 0;
-    frame_tree.clear();
+  void clear() { storage = std::make_unique<Storage>(); }   // release the whole arena
+
+  int size() const { return storage->plan_num; }   // the number of formation plans
+
+  std::size_t getMemorySize() const { return storage->arena.getSize(); }
+  std::size_t getMaxMemorySize() const { return max_memory_size; }
+  void setMaxMemorySize(std::size_t size) { max_memory_size = size; }   // applies to the next plans and the next collectGarbage()
+  bool isFull() const { return getMemorySize() >= max_memory_size; }   // no more plans can be added
+
+  void collectGarbage(const FrameTree& frame_tree);   // frame_tree is the frame tree that this plan is for
+
+  bool isFormationPlanExist(int frame1_id, int frame2_id) const {
+    int slot_id = getSlotId(frame2_id);
+    return slot_id >= 0 && storage->formation_plans[slot_id].getFrame1Id() == frame1_id;
   }
 
-  void nextStep() {
-    sim_step_count++;
+  const FormationPlan& getFormationPlan(int frame1_id, int frame2_id) const {
+    assert(isFormationPlanExist(frame1_id, frame2_id));
+    return storage->formation_plans[getSlotId(frame2_id)];
   }
 
-  int size() { return frame_tree.size(); }
+  FormationPlan& getFormationPlan(int frame1_id, int frame2_id) {
+    assert(isFormationPlanExist(frame1_id, frame2_id));
+    return storage->formation_plans[getSlotId(frame2_id)];
+  }
 
-  const FrameTree& getFrameTree() const { return frame_tree; }
+  bool addFormationPlan(int frame1_id, int frame2_id, const FormationPlan& plan) {
+    if (!emplaceFormationPlan(frame1_id, frame2_id)) return false;
+    getFormationPlan(frame1_id, frame2_id) = plan;   // copied into the arena
+    return true;
+  }
 
+  bool emplaceFormationPlan(int frame1_id, int frame2_id);   // add an empty plan, unless the arena is full
 
-  void setFrameTree(const FrameTree& new_frame_tree) {
-    frame_tree = new_frame_tree;
-  }
 
-  void attachFrameTree(const FrameTree& new_frame_tree) {
-    frame_tree.attachFrameSubtreeToTerminalFrame(new_frame_tree);
+  void print() const {
+    __pp__("ContingencyFormationPlan::print():");
+    for(std::size_t i = 0; i < storage->slot_ids.size(); i++) {
+      if (storage->slot_ids[i] < 0) continue;
+      auto& formation_plan = storage->formation_plans[storage->slot_ids[i]];
+      std::cout << "frame" << formation_plan.getFrame1Id() << " -> frame2" << formation_plan.getFrame2Id() << " : " << formation_plan << std::endl;
+    }
+    std::cout << std::endl;
   }
 
-  void removeFirstFrame() {
-    frame_tree.pop_front();
+private:
+
+  int getSlotId(int frame2_id) const {
+    int i = frame2_id - storage->first_frame2_id;
+    return (0 <= i && i < static_cast<int>(storage->slot_ids.size())) ? storage->slot_ids[i] : -1;
   }
 
+  static int& getSlotIdRef(Storage& storage, int frame2_id);   // extend the index to cover frame2_id
+
+  void removeFormationPlan(int frame2_id);
 
 };
 
 
 // -------------------------------------------------------------------------------------------
-//   Contingency Formation Plan
+//   The SPICOMP algorithm
 // -------------------------------------------------------------------------------------------
 
-class ContingencyFormationPlan {
+// The interpolation weights of the micro frames between two frames, (i+1)/MICRO_FRAME_NUM for the
+// i-th micro frame, so that the last micro frame is at frame2.
+template<int MICRO_FRAME_NUM>
+inline constexpr std::array<double, MICRO_FRAME_NUM> MICRO_FRAME_WEIGHTS = [] {
+  static_assert(MICRO_FRAME_NUM >= 1 && MICRO_FRAME_NUM <= MAX_MICRO_FRAME_NUM);
+  std::array<double, MICRO_FRAME_NUM> weights{};
+  for(int i = 0; i < MICRO_FRAME_NUM; i++) {
+    weights[i] = static_cast<double>(i + 1) / static_cast<double>(MICRO_FRAME_NUM);
+  }
+  return weights;
+}();
 
-  std::unordered_map<int,std::unordered_map<int,FormationPlan>> formation_plan_db;
 
-public:
+// The distances that the hidden drones fly to their new pixels, divided by the number of frames
+// that they have for the flight. The planner gathers them so that the effect of the cache and of
+// the staging targets on the flights can be measured (see bench/).
+struct HopStatistics {
+  int hop_num = 0;
+  double total_distance_per_frame = 0.0;
+  double max_distance_per_frame = 0.0;
 
-  void clear() { formation_plan_db.clear(); }
+  void add(double distance_per_frame) {
+    hop_num++;
+    total_distance_per_frame += distance_per_frame;
+    max_distance_per_frame = std::max(max_distance_per_frame, distance_per_frame);
+  }
 
-  bool isFormationPlanExist(int frame1_id, int frame2_id) const {
-    if (!formation_plan_db.contains(frame1_id)) return false;
-    return formation_plan_db.at(frame1_id).contains(frame2_id);
+  HopStatistics& operator+=(const HopStatistics& other) {
+    hop_num += other.hop_num;
+    total_distance_per_frame += other.total_distance_per_frame;
+    max_distance_per_frame = std::max(max_distance_per_frame, other.max_distance_per_frame);
+    return *this;
   }
 
-  const FormationPlan& getFormationPlan(int frame1_id, int frame2_id) const { return formation_plan_db.at(frame1_id).at(frame2_id); }
+  double getMeanDistancePerFrame() const { return (hop_num > 0) ? (total_distance_per_frame / hop_num) : 0.0; }
+};
 
-  FormationPlan& getFormationPlan(int frame1_id, int frame2_id) { return formation_plan_db.at(frame1_id).at(frame2_id); }
 
-  void addFormationPlan(int frame1_id, int frame2_id, const FormationPlan& plan) {
-    assert(!isFormationPlanExist(frame1_id, frame2_id));
-    formation_plan_db[frame1_id][frame2_id] = plan;
-  }
+// The new pixels of the frames of a frame tree, i.e., the pixels that do not persist from their
+// parent frames, counted in grid cells of STAGING_CELL_SIZE. They depend only on a frame and its
+// parent frame, so a frame is counted once, in the first replan that sees it, and the planner only
+// sums up the counts with the probabilities and the depths from its root frame. The frames that
+// leave the frame tree are dropped by collectGarbage().
 
-  void emplaceFormationPlan(int frame1_id, int frame2_id) {
-    assert(!isFormationPlanExist(frame1_id, frame2_id));
-    formation_plan_db[frame1_id].insert({frame2_id, FormationPlan(frame1_id, frame2_id)});
-  }
+class StagingDemandCache {
 
+public:
 
-  void print() const {
-    __pp__("ContingencyFormationPlan::print():");
-    for(auto& [frame1_id, formation_plan_db2] : formation_plan_db) {
-      for(auto& [frame2_id, formation_plan] : formation_plan_db2) {
-        std::cout << "frame" << frame1_id << " -> frame2" << frame2_id << " : " << formation_plan << std::endl;
-      }
-    }
-    std::cout << std::endl;
-  }
-};
+  struct CellDemand {
+    std::int64_t cell_key;
+    int pixel_num;
+    Pos3D pos_sum;   // the sum of the positions of the new pixels in the cell
+  };
+
+private:
 
+  int pixel_trajectory_tracking_num = -1;   // the tracking pixels are not new
+  std::unordered_map<int, std::vector<CellDemand>> frame_demands;   // frame id -> the new pixels by cell
+
+public:
+
+  int size() const { return frame_demands.size(); }
+
+  void clear() { frame_demands.clear(); }
+
+  // the new pixels of a frame that has a parent frame
+  const std::vector<CellDemand>& getFrameDemand(const FrameTree& frame_tree, int frame_id, int pixel_trajectory_tracking_num);
+
+  void collectGarbage(const FrameTree& frame_tree);   // drop the frames that are no longer in frame_tree
+
+};
 
-// -------------------------------------------------------------------------------------------
-//   The SPICOMP algorithm
-// -------------------------------------------------------------------------------------------
 
 class SpicompPlanner {
 
@@ -1082,76 +1797,118 @@ class SpicompPlanner {
   const int micro_frame_num;
 
   const FrameTree& frame_tree;
+  const int root_frame_id;                   // the search starts here, which may be below the root of frame_tree
   const Formation& init_formation;
   const DroneAssignment& init_assignment;
   const ContingencyFormationPlan& previous_cf_plan;
+  FormationPlanCache& formation_plan_cache;
+  const DynamicBitset& drone_availability;   // unavailable drones are never assigned to a new pixel
+  StagingDemandCache local_staging_demand_cache;
+  StagingDemandCache& staging_demand_cache;  // local_staging_demand_cache unless the caller keeps one across replans
 
   const int pixel_trajectory_tracking_num;   // TODO: for now, we assume the number of pixel trajectory tracking pixels is fixed.
+  const bool is_staging_enabled;             // whether the idle hidden drones move toward their staging targets
+
+  ContingencyFormationPlan cf_plan;
+  bool is_search_complete;   // whether every edge of the subtree has a formation plan, or the search stopped at the memory ceiling
 
-  ContingencyFormationPlan cf_plan;  // TODO: need to clean up formation plan in cf_plan
+  std::vector<int> search_frame_ids;  // the frame ids on the path from the root frame to the current frame in the search
+
+  std::vector<Pos3D> staging_targets;   // where an idle hidden drone waits for its next pixel
+  DynamicBitset has_staging_target;     // the idle hidden drones at the root frame that are sent to a staging target
+
+  HopStatistics hop_statistics;
 
 public:
 
   SpicompPlanner(int drone_num, int micro_frame_num, const FrameTree& frame_tree, const Formation& init_formation, const DroneAssignment& init_assignment,
-                 const ContingencyFormationPlan& previous_cf_plan, int pixel_trajectory_tracking_num) :
+                 const ContingencyFormationPlan& previous_cf_plan, FormationPlanCache& formation_plan_cache, const DynamicBitset& drone_availability,
+                 int pixel_trajectory_tracking_num, bool is_staging_enabled = true, StagingDemandCache* staging_demand_cache = nullptr) :
+      SpicompPlanner(drone_num, micro_frame_num, frame_tree, frame_tree.getRootFrameId(), init_formation, init_assignment, previous_cf_plan, formation_plan_cache,
+                     drone_availability, pixel_trajectory_tracking_num, is_staging_enabled, staging_demand_cache) {}
+
+  // plan the subtree of frame_tree rooted at root_frame_id
+  SpicompPlanner(int drone_num, int micro_frame_num, const FrameTree& frame_tree, int root_frame_id, const Formation& init_formation, const DroneAssignment& init_assignment,
+                 const ContingencyFormationPlan& previous_cf_plan, FormationPlanCache& formation_plan_cache, const DynamicBitset& drone_availability,
+                 int pixel_trajectory_tracking_num, bool is_staging_enabled = true, StagingDemandCache* staging_demand_cache = nullptr) :
       drone_num{drone_num}, micro_frame_num{micro_frame_num},
-      frame_tree{frame_tree}, init_formation{init_formation}, init_assignment{init_assignment},
-      previous_cf_plan(previous_cf_plan),
-      pixel_trajectory_tracking_num{pixel_trajectory_tracking_num}
+      frame_tree{frame_tree}, root_frame_id{root_frame_id}, init_formation{init_formation}, init_assignment{init_assignment},
+      previous_cf_plan(previous_cf_plan), formation_plan_cache(formation_plan_cache), drone_availability(drone_availability),
+      staging_demand_cache(staging_demand_cache != nullptr ? *staging_demand_cache : local_staging_demand_cache),
+      pixel_trajectory_tracking_num{pixel_trajectory_tracking_num}, is_staging_enabled{is_staging_enabled},
+      cf_plan(previous_cf_plan.getMaxMemorySize())
   {
     assert(init_formation.size() == drone_num);
-    solve();
+    assert(drone_availability.size() == drone_num);
+    computeStagingTargets();
+    is_search_complete = solve();
   }
 
   const ContingencyFormationPlan& getContingencyFormationPlan() const { return cf_plan; }
+  ContingencyFormationPlan releaseContingencyFormationPlan() { return std::move(cf_plan); }   // hand over the plan without copying it
+
+  const HopStatistics& getHopStatistics() const { return hop_statistics; }
+
+  bool isSearchComplete() const { return is_search_complete; }
+
+  bool hasStagingTarget(int drone_id) const { return has_staging_target.test(drone_id); }
+  const Pos3D& getStagingTarget(int drone_id) const { return staging_targets[drone_id]; }
+
+  // assign the unassigned pixels of frame2 by matching grid cells of pixels with nearby cells of drones, which is used
+  // instead of the flat assignment for HIERARCHICAL_ASSIGNMENT_MIN_DRONE_NUM or more candidate drones
+  static void assignHoppingPixelsHierarchically(DroneAssignment& assignment2, const Frame& frame2, const Formation& formation1, const DynamicBitset& unassigned_drone_ids,
+                                                const std::vector<std::int16_t>& hidden_since_depths, int search_depth);
+
+  // assign the unassigned pixels of frame2, in order, to the free candidate drones nearest to the cached drone positions
+  // within their cells, or in the cells of the pixels if available earlier; return false and leave assignment2 unchanged
+  // if both cells of a pixel run out of candidates
+  static bool adaptCachedHops(DroneAssignment& assignment2, const std::vector<Pos3D>& cached_drone_positions, const Frame& frame2,
+                              const Formation& formation1, const DynamicBitset& unassigned_drone_ids,
+                              const std::vector<std::int16_t>& hidden_since_depths, int search_depth);
 
 
 private:
 
-  bool solve() {
-    cf_plan.clear();
-    return solve(frame_tree.getRootFrameId(), init_formation, init_assignment, 0);
-  }
+  bool solve();   // the depth-first search, which returns false if it stopped at the memory ceiling
 
-  bool solve(int frame_id, const Formation& formation, const DroneAssignment& assignment, int search_depth);
+  void computeStagingTargets();   // send idle hidden drones to the cells that expect more new pixels in the frame tree than they have idle drones
 
   bool computeFormationPlan(FormationPlan& fplan, const Frame& frame1, const Frame& frame2, const Formation& formation1, const DroneAssignment& assignment1);
 
-  void computeEarliestAvailableMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel2, int pixel2_id, const std::vector<int>& parent_id_list);
+  void assignPersistentPixels(DroneAssignment& assignment2, std::vector<bool>& is_persistent_pixel, const Frame& frame1, const Frame& frame2, const DroneAssignment& assignment1) const;
 
-  void computeLinearMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1, const Pixel& pixel2);
+  void assignCorrespondingPixels(DroneAssignment& assignment2, std::vector<bool>& is_persistent_pixel, const Frame& frame1, const Frame& frame2, const DroneAssignment& assignment1) const;
 
-  void computeGoDarkMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1);
+  void computeEarliestAvailableMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel2, int pixel2_id, int hidden_since_depth);
 
+  void computeLinearMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1, const Pixel& pixel2);
 
-  std::list<int> findUnassignedDroneIds(const std::vector<int>& assignment2) const;
+  template<int MICRO_FRAME_NUM>
+  void computeLinearMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1, const Pixel& pixel2);   // unrolled for a common micro_frame_num
 
-  static std::list<int>::const_iterator findRandomNearbyDroneId(const Pos3D& pixel_pos, const Formation& formation1, const std::list<int>& unassigned_drone_ids);
+  void computeGoDarkMicroFormations(FormationPlan& fplan, int drone_id, const Pixel& pixel1);
 
-  static std::list<int>::const_iterator findRandomEarliestAvailableDroneId(const Pos3D& pixel_pos, const Formation& formation1, const std::list<int>& unassigned_drone_ids, const std::unordered_map<int, std::vector<int>>& earliest_available_frame_ids_db);
+  void computeStagingMicroFormations(FormationPlan& fplan, int drone_id, const Pos3D& pos1);
 
 
-  std::vector<int> findEarliestAvailableFrameId(const FormationPlan& fplan, int drone_id) const {
-    std::vector<int> parent_frame_id_list;
-    findEarliestAvailableFrameId(parent_frame_id_list, fplan, drone_id);
-    std::reverse(parent_frame_id_list.begin(), parent_frame_id_list.end());
-    return parent_frame_id_list;
+  DynamicBitset findUnassignedDroneIds(const DroneAssignment& assignment2) const {   // the available drones that are not assigned
+    return assignment2.getUnassignedDroneIds() & drone_availability;
   }
 
-  void findEarliestAvailableFrameId(std::vector<int>& parent_frame_id_list, const FormationPlan& fplan, int drone_id) const;
-
+  static int findRandomNearbyDroneId(const Pos3D& pixel_pos, const Formation& formation1, const DynamicBitset& unassigned_drone_ids);
 
-  static bool isDroneAssigned(int drone_id, const DroneAssignment& assignment) {
-    return std::find(assignment.begin(), assignment.end(), drone_id) != assignment.end();
-  }
+  static int findRandomEarliestAvailableDroneId(const Pos3D& pixel_pos, const Formation& formation1, const DynamicBitset& unassigned_drone_ids,
+                                                const std::vector<std::int16_t>& hidden_since_depths, int search_depth);
 
-  static int findAssignedPixelId(int drone_id, const DroneAssignment& assignment) {
-    for(int pixel_id=0; pixel_id<assignment.size(); pixel_id++) {
-      if (assignment[pixel_id] == drone_id) return pixel_id;
-    }
-    return -1;
+  static double getEarliestAvailableWeight(const Pos3D& pixel_pos, const Formation& formation1, int drone_id,
+                                           const std::vector<std::int16_t>& hidden_since_depths, int search_depth) {
+    assert(hidden_since_depths[drone_id] >= 0);
+    int flight_time_step = search_depth + 1 - hidden_since_depths[drone_id];
+    auto avg_distance = pixel_pos.distance(formation1.getDroneState(drone_id).getPos()) / flight_time_step;
+    return 1.0 / (avg_distance + EPSILON);
   }
 
+  std::vector<std::int16_t> computeHiddenSinceDepths(const DroneAssignment& partial_assignment2, int search_depth) const;
 
 };
 
@@ -1173,26 +1930,40 @@ class SpicompSimulator {
 
   int drone_num;
 
-  GameController game_controller;
-  FrameBuffer frame_buffer;
+  GameController game_controller;   // owns the frame tree
 
   std::uniform_real_distribution<> rand_scene_x;
   std::uniform_real_distribution<> rand_scene_y;
   std::uniform_real_distribution<> rand_scene_z;
 
   ContingencyFormationPlan cf_plan;
+  FormationPlanCache formation_plan_cache;
+  bool is_staging_enabled;
+  StagingDemandCache staging_demand_cache;
+
+  DynamicBitset drone_availability;
+
+  HopStatistics hop_statistics;   // of the plans that have been committed
+
+  // the plan for the next frame boundary, computed speculatively in the idle ticks
+  bool is_next_plan_ready;
+  ContingencyFormationPlan next_cf_plan;
+  HopStatistics next_hop_statistics;
 
 public:
 
   explicit SpicompSimulator(const SpicompSetting& setting) :
       setting{setting}, time_step_duration{0.02}, micro_frame_num{5},
       sim_step_count{0}, micro_frame_step_count{0}, drone_num{100},
-      game_controller(micro_frame_num), frame_buffer(micro_frame_num),
+      game_controller(micro_frame_num),
       rand_scene_x(-setting.getSceneSizeX() / 2.0, setting.getSceneSizeX() / 2.0),
       rand_scene_y(-setting.getSceneSizeY() / 2.0, setting.getSceneSizeY() / 2.0),
-      rand_scene_z(0.0, setting.getSceneSizeZ())
+      rand_scene_z(0.0, setting.getSceneSizeZ()),
+      is_staging_enabled{true}, is_next_plan_ready{false}
   {
     assert(micro_frame_num <= MAX_MICRO_FRAME_NUM);
+    assert(setting.getSceneSizeX() / 2.0 <= MAX_WORLD_COORD && setting.getSceneSizeY() / 2.0 <= MAX_WORLD_COORD &&
+           setting.getSceneSizeZ() <= MAX_WORLD_COORD);   // the coordinates must not be clamped when they are stored
   }
 
   void reset();
@@ -1201,16 +1972,47 @@ public:
 
   bool isStopped() const { return false; }
 
+  bool isDroneAvailable(int drone_id) const { return drone_availability.test(drone_id); }
+
+  bool disableDrone(int drone_id);   // mark a failed drone as unavailable and repair the current plan; return false if some pixels cannot be repaired
+
 
   [[nodiscard]] double getTimeStepDuration() const { return time_step_duration; }
 
   [[nodiscard]] int getSimStepCount() const { return sim_step_count; }
 
-  [[nodiscard]] Frame getCurrentMicroFrame() const;
+  [[nodiscard]] const Formation& getCurrentMicroFormation() const;   // valid until the next call of nextStep()
+
+  [[nodiscard]] const FormationPlanCache& getFormationPlanCache() const { return formation_plan_cache; }
+
+  [[nodiscard]] const HopStatistics& getHopStatistics() const { return hop_statistics; }
+
+  [[nodiscard]] const ContingencyFormationPlan& getContingencyFormationPlan() const { return cf_plan; }
+
+  [[nodiscard]] const FormationPlan& getCurrentFormationPlan() const;   // from the root frame to its default child
+
+  void setFormationPlanCacheCapacity(int capacity) { formation_plan_cache = FormationPlanCache(capacity); }   // 0 to disable the cache; call before reset()
+
+  void setStagingEnabled(bool is_enabled) { is_staging_enabled = is_enabled; }   // whether the idle hidden drones are staged; call before reset()
+
+  void setDroneNum(int num) { drone_num = num; }   // call before reset()
 
 private:
 
-  const FormationPlan& getCurrentFormationPlan() const;
+  void speculate();   // expand and plan the next frontier ahead of the frame boundary
+
+  bool repairFormationPlans(int subtree_root_frame_id, int failed_drone_id);
+
+  void handOverDroneRole(int subtree_root_frame_id, int failed_drone_id, int replacement_drone_id);
+
+  void pinFailedDrone(int subtree_root_frame_id, int failed_drone_id, const Pos3D& failed_drone_pos);   // in every plan in which it is dark
+
+  void limitReplacementDroneSpeed(int frame_id, int child_frame_id, int replacement_drone_id, const Pos3D& start_pos, int hidden_since_depth);
+
+  int findReplacementDroneId(int frame_id, int child_frame_id, int pixel2_id, const Formation& start_formation, const DynamicBitset& subtree_assigned_drone_ids) const;
+
+  // the drones assigned in the formation plans below each frame of the subtree, gathered by a single DFS
+  std::unordered_map<int, DynamicBitset> collectSubtreeAssignedDroneIds(int subtree_root_frame_id) const;
 
 };
 
@@ -0,0 +1,85 @@
+#include "test_util.h"
+#include "util/bitset.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   Set, Reset and Count
+// -------------------------------------------------------------------------------------------
+
+void testSetResetCount() {
+  DynamicBitset s(130);
+  CHECK(s.size() == 130 && s.count() == 0 && s.none());
+
+  for(int i : {0, 63, 64, 127, 128, 129}) s.set(i);   // both sides of each word boundary
+  CHECK(s.count() == 6 && s.any());
+  CHECK(s.test(63) && s.test(64) && s[129]);
+  CHECK(!s.test(1) && !s.test(62) && !s.test(65));
+
+  s.reset(64);
+  s.set(63, false);
+  CHECK(s.count() == 4 && !s.test(63) && !s.test(64));
+
+  s.setAll();
+  CHECK(s.count() == 130);    // the unused bits of the last word stay zero
+  s.resetAll();
+  CHECK(s.count() == 0);
+
+  DynamicBitset full(64, true);
+  CHECK(full.count() == 64);
+  CHECK((~full).count() == 0);
+  CHECK((~DynamicBitset(65)).count() == 65);
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Enumeration
+// -------------------------------------------------------------------------------------------
+
+void testFindNextAcrossWords() {
+  DynamicBitset s(200);
+  CHECK(s.findFirst() == -1);
+
+  std::vector<int> bit_ids = {5, 63, 64, 130, 199};
+  for(int i : bit_ids) s.set(i);
+
+  std::vector<int> found_ids;
+  for(int i = s.findFirst(); i >= 0; i = s.findNext(i)) found_ids.push_back(i);
+  CHECK(found_ids == bit_ids);
+
+  CHECK(s.findNext(5) == 63);
+  CHECK(s.findNext(64) == 130);    // skips the empty word between 65 and 127
+  CHECK(s.findNext(199) == -1);
+  s.reset(199);
+  CHECK(s.findNext(130) == -1);    // no set bit in the last word
+
+  std::vector<int> visited_ids;
+  s.forEachSetBit([&](int i) { visited_ids.push_back(i); });
+  CHECK(visited_ids == std::vector<int>({5, 63, 64, 130}));
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Set Operations
+// -------------------------------------------------------------------------------------------
+
+void testSetOperations() {
+  DynamicBitset s1(100), s2(100);
+  for(int i : {1, 63, 64, 99}) s1.set(i);
+  for(int i : {1, 64, 70}) s2.set(i);
+
+  CHECK((s1 & s2).count() == 2);
+  CHECK((s1 | s2).count() == 5);
+  CHECK((s1 ^ s2).count() == 3);
+
+  auto d = s1 - s2;
+  CHECK(d.count() == 2 && d.test(63) && d.test(99));
+  CHECK((d | (s1 & s2)) == s1);
+}
+
+
+int main() {
+  RUN_TEST(testSetResetCount);
+  RUN_TEST(testFindNextAcrossWords);
+  RUN_TEST(testSetOperations);
+  return 0;
+}
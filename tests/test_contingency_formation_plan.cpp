@@ -0,0 +1,158 @@
+#include "test_util.h"
+
+
+// frame0 decides between frame1 (the default) and frame2, which are followed by frame3 and frame4
+FrameTree makeDecisionFrameTree() {
+  FrameTree frame_tree;
+  for(int frame_id = 0; frame_id < 5; frame_id++) {
+    FrameBuilder builder;
+    builder.addPixel(Pixel(10.0 * frame_id, 0.0, 0.0, COLOR_RED), 0);
+    frame_tree.addFrame(builder.build(frame_id));
+  }
+  frame_tree.setRootFrameId(0);
+  frame_tree.setDecisionVariable(0, DecisionVariable(0, { 0, 1 }, 0));
+  frame_tree.addChildId(0, 0, 1);
+  frame_tree.addChildId(0, 1, 2);
+  frame_tree.addUniqueChildId(1, 3);
+  frame_tree.addUniqueChildId(2, 4);
+  return frame_tree;
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Garbage Collection
+// -------------------------------------------------------------------------------------------
+
+void testCollectGarbageKeepsLivePlans() {
+  auto frame_tree = makeDecisionFrameTree();
+  ContingencyFormationPlan cf_plan;
+  for(auto [frame1_id, frame2_id] : std::vector<std::pair<int, int>>{ {0, 1}, {0, 2}, {1, 3}, {2, 4} }) {
+    cf_plan.emplaceFormationPlan(frame1_id, frame2_id);
+  }
+  cf_plan.collectGarbage(frame_tree);
+  CHECK(cf_plan.size() == 4);
+}
+
+
+// The branch that pop_front() detaches stays in the frame tree until it is reclaimed, but its plans
+// must be collected right away.
+void testCollectGarbageSkipsDiscardedBranches() {
+  auto frame_tree = makeDecisionFrameTree();
+  ContingencyFormationPlan cf_plan;
+  for(auto [frame1_id, frame2_id] : std::vector<std::pair<int, int>>{ {0, 1}, {0, 2}, {1, 3}, {2, 4} }) {
+    cf_plan.emplaceFormationPlan(frame1_id, frame2_id);
+  }
+
+  frame_tree.pop_front();
+  CHECK(frame_tree.hasDiscardedFrames() && frame_tree.isFrameExist(2) && frame_tree.hasChildFrameId(2, 4));
+
+  cf_plan.collectGarbage(frame_tree);
+  CHECK(cf_plan.size() == 1);
+  CHECK(cf_plan.isFormationPlanExist(1, 3));
+  CHECK(!cf_plan.isFormationPlanExist(2, 4));
+
+  frame_tree.reclaimDiscardedFrames();   // reclaiming afterwards changes nothing
+  cf_plan.collectGarbage(frame_tree);
+  CHECK(cf_plan.size() == 1 && cf_plan.isFormationPlanExist(1, 3));
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Memory Ceiling
+// -------------------------------------------------------------------------------------------
+
+const int CEILING_TEST_DRONE_NUM = 1000;
+const int CEILING_TEST_MICRO_FRAME_NUM = 5;
+
+
+ContingencyFormationPlan makePlan(const GameController& game_controller, const FrameTree& frame_tree, std::size_t max_memory_size, bool& is_search_complete) {
+  seedTestRand(39);
+  auto [init_formation, init_assignment] = makeInitFormation(frame_tree.getRootFrame(), CEILING_TEST_DRONE_NUM);
+  DynamicBitset drone_availability(CEILING_TEST_DRONE_NUM, true);
+  ContingencyFormationPlan previous_cf_plan(max_memory_size);
+  FormationPlanCache cache(0);
+  SpicompPlanner planner(CEILING_TEST_DRONE_NUM, CEILING_TEST_MICRO_FRAME_NUM, frame_tree, init_formation, init_assignment, previous_cf_plan, cache,
+                         drone_availability, game_controller.getPixelTrajectoryTrackingNum());
+  is_search_complete = planner.isSearchComplete();
+  return planner.releaseContingencyFormationPlan();
+}
+
+
+// The search stops when the arena reaches the ceiling, and the most likely path is planned first.
+void testSearchStopsAtCeiling() {
+  GameController game_controller(CEILING_TEST_MICRO_FRAME_NUM);
+  game_controller.growInitFrameTree();
+  auto& frame_tree = game_controller.getFrameTree();
+
+  bool is_search_complete = false;
+  auto full_cf_plan = makePlan(game_controller, frame_tree, CONTINGENCY_FORMATION_PLAN_MAX_MEMORY_SIZE, is_search_complete);
+  CHECK(is_search_complete);
+  const std::size_t max_memory_size = 2 * CONTINGENCY_FORMATION_PLAN_ARENA_SIZE;
+  CHECK(full_cf_plan.getMemorySize() > max_memory_size);   // large enough to be trimmed
+
+  auto cf_plan = makePlan(game_controller, frame_tree, max_memory_size, is_search_complete);
+  CHECK(!is_search_complete);
+  CHECK(cf_plan.isFull() && cf_plan.getMemorySize() <= max_memory_size + CONTINGENCY_FORMATION_PLAN_ARENA_SIZE);
+  CHECK(cf_plan.size() < full_cf_plan.size());
+  CHECK(!cf_plan.emplaceFormationPlan(-1, 1 << 20));
+
+  int depth = 0;   // the plans along the default path
+  for(int frame_id = frame_tree.getRootFrameId(); !frame_tree.isTerminalFrame(frame_id); depth++) {
+    int child_frame_id = frame_tree.isDecisionFrame(frame_id) ? frame_tree.getDefaultChildFrameId(frame_id) : frame_tree.getUniqueChildFrameId(frame_id);
+    if (!cf_plan.isFormationPlanExist(frame_id, child_frame_id)) break;
+    frame_id = child_frame_id;
+  }
+  CHECK(depth >= 2);
+  forEachFrameTreeEdge(frame_tree, [&](int frame1_id, int frame2_id) {   // a planned edge has a planned parent edge
+    if (!cf_plan.isFormationPlanExist(frame1_id, frame2_id) || frame1_id == frame_tree.getRootFrameId()) return;
+    CHECK(cf_plan.isFormationPlanExist(frame_tree.getParentFrameId(frame1_id), frame1_id));
+  });
+}
+
+
+// After the plans of the discarded branches are removed, the arena is mostly garbage. The live
+// plans that fit in half of the ceiling are all kept, however deep they are.
+void testCompactionKeepsLivePlansThatFit() {
+  GameController game_controller(CEILING_TEST_MICRO_FRAME_NUM);
+  game_controller.growInitFrameTree();
+  FrameTree frame_tree = game_controller.getFrameTree();
+
+  bool is_search_complete = false;
+  auto cf_plan = makePlan(game_controller, frame_tree, CONTINGENCY_FORMATION_PLAN_MAX_MEMORY_SIZE, is_search_complete);
+  CHECK(is_search_complete);
+  auto memory_size = cf_plan.getMemorySize();
+
+  int decision_frame_num = 0;
+  while(decision_frame_num < 3) {   // discard three branches
+    if (frame_tree.isDecisionFrame(frame_tree.getRootFrameId())) decision_frame_num++;
+    frame_tree.reclaimDiscardedFrames();
+    frame_tree.pop_front();
+  }
+  frame_tree.reclaimDiscardedFrames();
+  int live_plan_num = 0;
+  forEachFrameTreeEdge(frame_tree, [&](int, int) { live_plan_num++; });
+
+  cf_plan.setMaxMemorySize(memory_size - CONTINGENCY_FORMATION_PLAN_ARENA_SIZE);   // the arena is above the ceiling
+  cf_plan.collectGarbage(frame_tree);
+  CHECK(cf_plan.size() == live_plan_num);
+  CHECK(cf_plan.getMemorySize() < memory_size / 2);
+  forEachFrameTreeEdge(frame_tree, [&](int frame1_id, int frame2_id) { CHECK(cf_plan.isFormationPlanExist(frame1_id, frame2_id)); });
+
+  // if the ceiling is far too low, the plans of the current and the next frame are still kept
+  cf_plan.setMaxMemorySize(1);
+  cf_plan.collectGarbage(frame_tree);
+  CHECK(0 < cf_plan.size() && cf_plan.size() < live_plan_num);
+  forEachFrameTreeEdge(frame_tree, [&](int frame1_id, int frame2_id) {
+    bool is_near = frame1_id == frame_tree.getRootFrameId() || frame_tree.getParentFrameId(frame1_id) == frame_tree.getRootFrameId();
+    CHECK(cf_plan.isFormationPlanExist(frame1_id, frame2_id) == is_near);
+  });
+}
+
+
+int main() {
+  RUN_TEST(testCollectGarbageKeepsLivePlans);
+  RUN_TEST(testCollectGarbageSkipsDiscardedBranches);
+  RUN_TEST(testSearchStopsAtCeiling);
+  RUN_TEST(testCompactionKeepsLivePlansThatFit);
+  return 0;
+}
@@ -0,0 +1,43 @@
+#include "test_util.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   Equality
+// -------------------------------------------------------------------------------------------
+
+void testEquality() {
+  DroneAssignment assignment1(3, 6);
+  assignment1.assign(0, 4);
+  assignment1.assign(1, 2);
+
+  DroneAssignment assignment2(3, 6);   // the same pixels and drones, assigned in another order
+  assignment2.assign(1, 2);
+  assignment2.assign(0, 5);
+  assignment2.assign(0, 4);
+  CHECK(assignment1 == assignment2);
+  CHECK(assignment2.getPixelId(5) == -1);
+
+  assignment2.swapDroneIds(4, 5);   // the drone of pixel 0 changes
+  CHECK(!(assignment1 == assignment2));
+  assignment2.swapDroneIds(4, 5);
+  CHECK(assignment1 == assignment2);
+
+  assignment2.swapDroneIds(3, 5);   // two unassigned drones change nothing
+  CHECK(assignment1 == assignment2);
+
+  assignment2.assign(2, 3);
+  CHECK(!(assignment1 == assignment2));
+  assignment2.unassign(2);
+  CHECK(assignment1 == assignment2);
+
+  DroneAssignment assignment3(3, 7);   // the same pixels, but another drone number
+  assignment3.assign(0, 4);
+  assignment3.assign(1, 2);
+  CHECK(!(assignment1 == assignment3));
+}
+
+
+int main() {
+  RUN_TEST(testEquality);
+  return 0;
+}
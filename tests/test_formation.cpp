@@ -0,0 +1,90 @@
+#include <utility>
+
+#include "test_util.h"
+
+
+// two formations share the chunk of a drone if its const drone states are the same object
+bool isSharingDroneState(const Formation& formation1, const Formation& formation2, int drone_id) {
+  return &formation1.getDroneState(drone_id) == &formation2.getDroneState(drone_id);
+}
+
+Formation makeFormation(int drone_num) {
+  Formation formation;
+  for(int drone_id = 0; drone_id < drone_num; drone_id++) {
+    formation.addDroneState(drone_id, 0.0, 10.0, COLOR_HIDDEN);
+  }
+  return formation;
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Copy-on-Write
+// -------------------------------------------------------------------------------------------
+
+void testCopySharesChunks() {
+  const int drone_num = 3 * FORMATION_CHUNK_SIZE + 1;
+  const auto formation = makeFormation(drone_num);   // const, since the non-const getDroneState() unshares a chunk
+  Formation copy = formation;
+  for(int drone_id = 0; drone_id < drone_num; drone_id++) {
+    CHECK(isSharingDroneState(formation, copy, drone_id));
+  }
+
+  Formation assigned;
+  assigned = formation;
+  CHECK(isSharingDroneState(formation, assigned, drone_num - 1));
+}
+
+
+void testWriteCopiesOnlyItsChunk() {
+  const int drone_num = 2 * FORMATION_CHUNK_SIZE;
+  const auto formation = makeFormation(drone_num);
+  Formation copy = formation;
+
+  copy.setDroneState(3, Pos3D(100.0, 0.0, 0.0), COLOR_RED);
+  CHECK(!isSharingDroneState(formation, copy, 0));                       // the chunk of drone 3 is copied
+  CHECK(isSharingDroneState(formation, copy, FORMATION_CHUNK_SIZE));     // the other chunk is still shared
+  CHECK(formation.getDroneState(3).getPos() == Pos3D(3.0, 0.0, 10.0));   // the original is unchanged
+  CHECK(copy.getDroneState(3).getPos() == Pos3D(100.0, 0.0, 0.0) && copy.getDroneState(3).getColor() == COLOR_RED);
+  CHECK(copy.getDroneState(2).getPos() == formation.getDroneState(2).getPos());
+
+  // writing the same state does not copy the chunk
+  copy.setDroneState(FORMATION_CHUNK_SIZE + 1, formation.getDroneState(FORMATION_CHUNK_SIZE + 1).getPos(), COLOR_HIDDEN);
+  CHECK(isSharingDroneState(formation, copy, FORMATION_CHUNK_SIZE));
+
+  // neither does swapping within an unshared chunk affect the original
+  copy.swapDroneStates(3, 4);
+  CHECK(copy.getDroneState(4).getColor() == COLOR_RED && formation.getDroneState(4).getPos() == Pos3D(4.0, 0.0, 10.0));
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Memory Resources
+// -------------------------------------------------------------------------------------------
+
+void testChunksStayInTheirMemoryResource() {
+  const int drone_num = 2 * FORMATION_CHUNK_SIZE;
+  const auto formation = makeFormation(drone_num);
+
+  std::pmr::monotonic_buffer_resource arena;
+  Formation arena_copy(formation, Formation::allocator_type(&arena));
+  CHECK(!isSharingDroneState(formation, arena_copy, 0));   // a chunk never outlives its arena
+
+  // copies through a translation keep the sharing among the formations moved to the arena
+  Formation sibling = formation;
+  sibling.setDroneState(0, Pos3D(1.0, 1.0, 1.0), COLOR_RED);
+  Formation::ChunkTranslation translation;
+  Formation moved1(formation, translation, Formation::allocator_type(&arena));
+  Formation moved2(sibling, translation, Formation::allocator_type(&arena));
+  CHECK(!isSharingDroneState(moved1, formation, FORMATION_CHUNK_SIZE));
+  CHECK(isSharingDroneState(moved1, moved2, FORMATION_CHUNK_SIZE));
+  CHECK(!isSharingDroneState(moved1, moved2, 0));
+  CHECK(moved2.getDroneState(0).getColor() == COLOR_RED && moved1.getDroneState(0).getColor() == COLOR_HIDDEN);
+}
+
+
+int main() {
+  RUN_TEST(testCopySharesChunks);
+  RUN_TEST(testWriteCopiesOnlyItsChunk);
+  RUN_TEST(testChunksStayInTheirMemoryResource);
+  return 0;
+}
@@ -0,0 +1,216 @@
+#include "test_util.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   LRU Eviction
+// -------------------------------------------------------------------------------------------
+
+void testLruEviction() {
+  FormationPlanCache cache(2);
+  std::vector<Pos3D> positions_a = { Pos3D(1.0, 0.0, 0.0) }, positions_b = { Pos3D(2.0, 0.0, 0.0) }, positions_c = { Pos3D(3.0, 0.0, 0.0) };
+
+  cache.insert(1, positions_a);
+  cache.insert(2, positions_b);
+  CHECK(cache.find(1) != nullptr);   // 1 becomes the most recently used entry
+  cache.insert(3, positions_c);      // so 2 is evicted
+
+  CHECK(cache.size() == 2);
+  CHECK(cache.find(2) == nullptr);
+  CHECK(cache.find(1) != nullptr && *cache.find(1) == positions_a);
+  CHECK(cache.find(3) != nullptr && *cache.find(3) == positions_c);
+
+  cache.insert(1, positions_b);      // overwrite without eviction
+  CHECK(cache.size() == 2);
+  CHECK(*cache.find(1) == positions_b);
+
+  FormationPlanCache disabled_cache(0);
+  disabled_cache.insert(1, positions_a);
+  CHECK(!disabled_cache.isEnabled());
+  CHECK(disabled_cache.size() == 0 && disabled_cache.find(1) == nullptr);
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Fingerprint
+// -------------------------------------------------------------------------------------------
+
+void testFingerprintCoversNewPixels() {
+  auto makeFingerprint = [](const Pos3D& persistent_pos, const Pos3D& new_pos) {
+    FrameBuilder builder;
+    builder.addPixel(Pixel(persistent_pos, COLOR_RED), 0);
+    builder.addPixel(Pixel(new_pos, COLOR_GREEN), 1);
+    DroneAssignment assignment2(2, 3);
+    assignment2.assign(0, 0);   // pixel 1 is new
+    return FormationPlanCache::makeFingerprint(builder.build(), assignment2);
+  };
+  auto fingerprint = makeFingerprint(Pos3D(0.0, 0.0, 0.0), Pos3D(110.0, 0.0, 0.0));
+
+  // a new pixel in the same quantization cell gives the same key
+  CHECK(fingerprint == makeFingerprint(Pos3D(0.0, 0.0, 0.0), Pos3D(120.0, 10.0, 10.0)));
+
+  // a new pixel in another cell gives another key
+  CHECK(fingerprint != makeFingerprint(Pos3D(0.0, 0.0, 0.0), Pos3D(160.0, 0.0, 0.0)));
+
+  // but a persistent pixel does not matter, since it keeps its drone
+  CHECK(fingerprint == makeFingerprint(Pos3D(300.0, 0.0, 0.0), Pos3D(110.0, 0.0, 0.0)));
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Adaptation
+// -------------------------------------------------------------------------------------------
+
+void testAdaptCachedHops() {
+  Formation formation1;
+  formation1.addDroneState(Pixel(0.0, 0.0, 0.0, COLOR_RED));
+  formation1.addDroneState(110.0, 0.0, 0.0, COLOR_HIDDEN);
+  formation1.addDroneState(120.0, 10.0, 10.0, COLOR_HIDDEN);
+  formation1.addDroneState(310.0, 0.0, 0.0, COLOR_HIDDEN);
+  formation1.addDroneState(111.0, 0.0, 0.0, COLOR_HIDDEN);   // not a candidate
+  formation1.addDroneState(-210.0, 0.0, 0.0, COLOR_HIDDEN);
+  DynamicBitset unassigned_drone_ids(6);
+  for(int drone_id : { 1, 2, 3, 5 }) unassigned_drone_ids.set(drone_id);
+  std::vector<std::int16_t> hidden_since_depths = { -1, 0, 0, 0, 0, 0 };   // hidden since frame1
+  int search_depth = 0;
+
+  auto makeFrame2 = [](const Pos3D& new_pos1, const Pos3D& new_pos2) {
+    FrameBuilder builder;
+    builder.addPixel(Pixel(0.0, 0.0, 0.0, COLOR_RED), 0);
+    builder.addPixel(Pixel(new_pos1, COLOR_GREEN), 1);
+    builder.addPixel(Pixel(new_pos2, COLOR_GREEN), 2);
+    return builder.build();
+  };
+  auto frame2 = makeFrame2(Pos3D(0.0, 200.0, 0.0), Pos3D(0.0, 300.0, 0.0));   // no candidates in the cells of the new pixels
+  DroneAssignment partial_assignment2(3, 6);   // pixels 1 and 2 are new
+  partial_assignment2.assign(0, 0);
+
+  // each new pixel takes the candidate nearest to its cached drone within the cell
+  auto assignment2 = partial_assignment2;
+  CHECK(SpicompPlanner::adaptCachedHops(assignment2, { Pos3D(119.0, 9.0, 9.0), Pos3D(111.0, 0.0, 0.0) }, frame2, formation1, unassigned_drone_ids, hidden_since_depths, search_depth));
+  CHECK(assignment2[0] == 0 && assignment2[1] == 2 && assignment2[2] == 1);
+
+  // or the next nearest, if the nearest is taken
+  assignment2 = partial_assignment2;
+  CHECK(SpicompPlanner::adaptCachedHops(assignment2, { Pos3D(111.0, 0.0, 0.0), Pos3D(112.0, 0.0, 0.0) }, frame2, formation1, unassigned_drone_ids, hidden_since_depths, search_depth));
+  CHECK(assignment2[1] == 1 && assignment2[2] == 2);
+
+  // or a candidate in the cell of the new pixel, if it is available earlier
+  assignment2 = partial_assignment2;
+  CHECK(SpicompPlanner::adaptCachedHops(assignment2, { Pos3D(111.0, 0.0, 0.0), Pos3D(112.0, 0.0, 0.0) },
+                                        makeFrame2(Pos3D(-205.0, 0.0, 0.0), Pos3D(0.0, 300.0, 0.0)), formation1, unassigned_drone_ids, hidden_since_depths, search_depth));
+  CHECK(assignment2[1] == 5 && assignment2[2] == 1);
+
+  // a new pixel without free candidates in both cells is a miss, which leaves assignment2 unchanged
+  assignment2 = partial_assignment2;
+  CHECK(!SpicompPlanner::adaptCachedHops(assignment2, { Pos3D(111.0, 0.0, 0.0), Pos3D(400.0, 0.0, 0.0) }, frame2, formation1, unassigned_drone_ids, hidden_since_depths, search_depth));
+  CHECK(!SpicompPlanner::adaptCachedHops(assignment2, { Pos3D(310.0, 0.0, 0.0), Pos3D(311.0, 0.0, 0.0) }, frame2, formation1, unassigned_drone_ids, hidden_since_depths, search_depth));
+  CHECK(!SpicompPlanner::adaptCachedHops(assignment2, { Pos3D(111.0, 0.0, 0.0) }, frame2, formation1, unassigned_drone_ids, hidden_since_depths, search_depth));
+  CHECK(assignment2 == partial_assignment2);
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Cache Hits
+// -------------------------------------------------------------------------------------------
+
+// frame0 has one pixel, and frame1 adds two new pixels to it
+FrameTree makeNewPixelFrameTree() {
+  FrameTree frame_tree;
+  FrameBuilder builder;
+  builder.addPixel(Pixel(0.0, 0.0, 100.0, COLOR_RED), 0);
+  frame_tree.addFrame(builder.build(0));
+  builder.addPixel(Pixel(0.0, 0.0, 100.0, COLOR_RED), 0);
+  builder.addPixel(Pixel(100.0, 0.0, 100.0, COLOR_GREEN), 1);
+  builder.addPixel(Pixel(0.0, 100.0, 100.0, COLOR_BLUE), 2);
+  frame_tree.addFrame(builder.build(1));
+  frame_tree.setRootFrameId(0);
+  frame_tree.addUniqueChildId(0, 1);
+  return frame_tree;
+}
+
+
+// A recurring subproblem is a hit, with the same drones while they stay where they were, and with
+// the nearest drones in the same cells when they have moved a little. It is a miss when they have
+// left their cells.
+void testCacheHitAdaptsToMovedDrones() {
+  const int drone_num = 20;
+  const int micro_frame_num = 5;
+
+  seedTestRand(7);
+  auto frame_tree = makeNewPixelFrameTree();
+  auto [init_formation, init_assignment] = makeInitFormation(frame_tree.getRootFrame(), drone_num);
+  for(int drone_id = init_assignment.size(); drone_id < drone_num; drone_id++) {
+    init_formation.setDroneState(drone_id, init_formation.getDroneState(drone_id).getPos(), COLOR_HIDDEN);   // as a hidden drone of a plan
+  }
+  DynamicBitset drone_availability(drone_num, true);
+  ContingencyFormationPlan previous_cf_plan;
+  FormationPlanCache cache;
+
+  auto plan = [&](const Formation& formation) {
+    SpicompPlanner planner(drone_num, micro_frame_num, frame_tree, formation, init_assignment, previous_cf_plan, cache, drone_availability, 0, false);
+    return planner.getContingencyFormationPlan().getFormationPlan(0, 1).getAssignment2();
+  };
+
+  auto assignment2 = plan(init_formation);
+  CHECK(cache.getHitCount() == 0 && cache.getMissCount() == 1);
+
+  seedTestRand(12);   // a hit does not draw random numbers, so the seed must not matter
+  CHECK(plan(init_formation) == assignment2);
+  CHECK(cache.getHitCount() == 1);
+
+  auto nudged_formation = init_formation;   // the hidden drones move within their cells
+  for(int drone_id = init_assignment.size(); drone_id < drone_num; drone_id++) {
+    auto pos = nudged_formation.getDroneState(drone_id).getPos();
+    auto nudged_pos = Pos3D(pos.x + 1.0, pos.y, pos.z);
+    if (FormationPlanCache::makeCellKey(nudged_pos) == FormationPlanCache::makeCellKey(pos)) nudged_formation.setDroneState(drone_id, nudged_pos, COLOR_HIDDEN);
+  }
+  CHECK(plan(nudged_formation) == assignment2);
+  CHECK(cache.getHitCount() == 2);
+
+  auto moved_formation = init_formation;   // the hidden drones gather outside of the scene
+  for(int drone_id = init_assignment.size(); drone_id < drone_num; drone_id++) {
+    moved_formation.setDroneState(drone_id, Pos3D(-400.0 + drone_id, -400.0, 0.0), COLOR_HIDDEN);
+  }
+  plan(moved_formation);
+  CHECK(cache.getHitCount() == 2 && cache.getMissCount() == 2);
+}
+
+
+// The new pixels of the frames of a game recur, so a frame tree of a game hits the cache.
+void testCacheHitsInGameFrameTree() {
+  const int drone_num = 100;
+  const int micro_frame_num = 5;
+
+  seedTestRand(7);
+  GameController game_controller(micro_frame_num);
+  game_controller.growInitFrameTree();
+  auto& frame_tree = game_controller.getFrameTree();
+  auto [init_formation, init_assignment] = makeInitFormation(frame_tree.getRootFrame(), drone_num);
+  DynamicBitset drone_availability(drone_num, true);
+  ContingencyFormationPlan previous_cf_plan;
+  FormationPlanCache cache;
+
+  SpicompPlanner planner(drone_num, micro_frame_num, frame_tree, init_formation, init_assignment, previous_cf_plan, cache, drone_availability,
+                         game_controller.getPixelTrajectoryTrackingNum());
+  CHECK(cache.getHitCount() > 0);
+
+  // every new pixel is taken by a drone that was hidden
+  auto& cf_plan = planner.getContingencyFormationPlan();
+  forEachFrameTreeEdge(frame_tree, [&](int frame1_id, int frame2_id) {
+    auto& fplan = cf_plan.getFormationPlan(frame1_id, frame2_id);
+    CHECK(fplan.getAssignment2().isComplete());
+    for(auto drone_id : fplan.getAssignment2()) {
+      CHECK(fplan.getAssignment1().isDroneAssigned(drone_id) || fplan.getFormation1().getDroneState(drone_id).getIsHidden());
+    }
+  });
+}
+
+
+int main() {
+  RUN_TEST(testLruEviction);
+  RUN_TEST(testFingerprintCoversNewPixels);
+  RUN_TEST(testAdaptCachedHops);
+  RUN_TEST(testCacheHitAdaptsToMovedDrones);
+  RUN_TEST(testCacheHitsInGameFrameTree);
+  return 0;
+}
@@ -0,0 +1,202 @@
+#include <atomic>
+#include <thread>
+
+#include "test_util.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   Columns
+// -------------------------------------------------------------------------------------------
+
+void testColumns() {
+  FrameBuilder builder;
+  builder.reserve(3);
+  builder.addPixel(1.0, 2.0, 3.0, COLOR_RED);
+  builder.addPixel(Pixel(4.0, 5.0, 6.0, COLOR_GREEN));
+  builder.addPixel(7.0, 8.0, 9.0, COLOR_BLUE);
+  Frame frame = builder.build(2);
+  CHECK(frame.size() == 3 && frame.getId() == 2);
+  CHECK(builder.size() == 0);   // build() leaves the builder empty
+  CHECK(!frame.hasPixelIdentities());
+
+  auto xs = frame.getXs();
+  auto ys = frame.getYs();
+  auto zs = frame.getZs();
+  auto colors = frame.getColors();
+  CHECK(xs.size() == 3 && ys.size() == 3 && zs.size() == 3 && colors.size() == 3);
+  for(int pixel_id = 0; pixel_id < frame.size(); pixel_id++) {
+    CHECK(frame.getPos(pixel_id) == Pos3D(xs[pixel_id], ys[pixel_id], zs[pixel_id]));
+    CHECK(frame.getColor(pixel_id) == colors[pixel_id]);
+    CHECK(frame.getPixel(pixel_id) == Pixel(xs[pixel_id], ys[pixel_id], zs[pixel_id], colors[pixel_id]));
+  }
+  CHECK(frame.getPixel(1) == Pixel(4.0, 5.0, 6.0, COLOR_GREEN));
+
+  frame.translate(10.0, -1.0, 0.5);
+  CHECK(frame.getPos(0) == Pos3D(11.0, 1.0, 3.5));
+  CHECK(frame.getPos(2) == Pos3D(17.0, 7.0, 9.5));
+  CHECK(frame.getColor(2) == COLOR_BLUE);
+}
+
+
+void testPixelIdentities() {
+  FrameBuilder builder1, builder2;
+  builder1.addPixel(Pixel(1.0, 0.0, 0.0, COLOR_RED), 5);
+  builder2.addPixel(Pixel(2.0, 0.0, 0.0, COLOR_GREEN), 7);
+  builder2.addPixel(Pixel(3.0, 0.0, 0.0, COLOR_BLUE), 8);
+  Frame frame1 = builder1.build();
+  Frame frame2 = builder2.build();
+  CHECK(frame1.hasPixelIdentities() && frame2.hasPixelIdentities());
+
+  builder1.addPixels(frame1);
+  builder1.addPixels(frame2);
+  Frame frame3 = builder1.build();
+  CHECK(frame3.size() == 3 && frame3.hasPixelIdentities());
+  CHECK(frame3.getPixelIdentity(0) == 5 && frame3.getPixelIdentity(1) == 7 && frame3.getPixelIdentity(2) == 8);
+  CHECK(frame3.getPixel(2) == Pixel(3.0, 0.0, 0.0, COLOR_BLUE));
+
+  builder1.addPixels(frame3);
+  builder1.addPixels(frame3);
+  Frame frame4 = builder1.build();
+  CHECK(frame4.size() == 6 && frame4.getPixelIdentity(5) == 8 && frame4.getPos(3) == Pos3D(1.0, 0.0, 0.0));
+  CHECK(frame3.size() == 3);
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Shared Pixels
+// -------------------------------------------------------------------------------------------
+
+void testEmptyFrame() {
+  Frame frame;
+  CHECK(frame.size() == 0 && frame.getId() == -1);
+  CHECK(frame.getXs().empty() && frame.getColors().empty() && !frame.hasPixelIdentities());
+  CHECK(frame.isSharingPixels(Frame()));   // no columns are allocated for an empty frame
+
+  frame.translate(1.0, 2.0, 3.0);
+  CHECK(frame.size() == 0);
+  CHECK(FrameBuilder().build().isSharingPixels(frame));
+}
+
+
+void testCopySharesPixels() {
+  FrameBuilder builder;
+  builder.addPixel(Pixel(1.0, 2.0, 3.0, COLOR_RED), 10);
+  builder.addPixel(Pixel(4.0, 5.0, 6.0, COLOR_GREEN), 11);
+  Frame frame = builder.build(1);
+
+  Frame copy = frame;
+  CHECK(copy.isSharingPixels(frame));
+
+  copy.translate(10.0, 0.0, 0.0);    // the copy gets its own pixels and the frame is unchanged
+  CHECK(!copy.isSharingPixels(frame));
+  CHECK(frame.getPos(0) == Pos3D(1.0, 2.0, 3.0));
+  CHECK(copy.getPos(0) == Pos3D(11.0, 2.0, 3.0));
+  CHECK(copy.getPixelIdentity(1) == 11 && copy.getColor(1) == COLOR_GREEN);
+
+  Frame other_copy = frame;   // translating a frame that is not shared copies its columns too
+  frame.translate(0.0, 1.0, 0.0);
+  CHECK(other_copy.getPos(1) == Pos3D(4.0, 5.0, 6.0));
+  CHECK(frame.getPos(1) == Pos3D(4.0, 6.0, 6.0));
+}
+
+
+// Copies of a frame are read from several threads while one of them is translated.
+void testConcurrentCopies() {
+  FrameBuilder builder;
+  for(int i = 0; i < 100; i++) {
+    builder.addPixel(Pixel(i, 0.0, 0.0, COLOR_RED), i);
+  }
+  const Frame frame = builder.build(0);
+
+  std::vector<std::thread> threads;
+  std::atomic<int> error_num = 0;
+  for(int thread_id = 0; thread_id < 4; thread_id++) {
+    threads.emplace_back([&, thread_id]() {
+      for(int round = 0; round < 100; round++) {
+        Frame copy = frame;
+        copy.translate(thread_id + 1.0, 0.0, 0.0);
+        for(int pixel_id = 0; pixel_id < copy.size(); pixel_id++) {
+          if (copy.getPos(pixel_id).x != pixel_id + thread_id + 1.0 || frame.getPos(pixel_id).x != pixel_id) error_num++;
+        }
+      }
+    });
+  }
+  for(auto& thread : threads) thread.join();
+  CHECK(error_num == 0);
+}
+
+
+// The next frontier is expanded while the current frame is still shown, and the frame boundary
+// removes the root in place, so the frames that stay are never copied.
+void testNextFrontierGrowsInPlace() {
+  const int micro_frame_num = 5;
+
+  seedTestRand(5);
+  GameController game_controller(micro_frame_num);
+  game_controller.growInitFrameTree();
+
+  auto& frame_tree = game_controller.getFrameTree();
+  int root_frame_id = frame_tree.getRootFrameId();
+  int next_root_frame_id = game_controller.getNextRootFrameId();
+  CHECK(frame_tree.hasChildFrameId(root_frame_id, next_root_frame_id));
+
+  std::vector<std::pair<int, const Frame*>> kept_frames;   // the frames in the subtree of the next root frame
+  forEachFrameTreeEdge(frame_tree, [&](int, int frame2_id) { kept_frames.emplace_back(frame2_id, &frame_tree.getFrame(frame2_id)); });
+  std::erase_if(kept_frames, [&](auto& kept_frame) {
+    int frame_id = kept_frame.first;
+    while(frame_id != next_root_frame_id && frame_tree.hasParentFrameId(frame_id)) frame_id = frame_tree.getParentFrameId(frame_id);
+    return frame_id != next_root_frame_id;
+  });
+  CHECK(!kept_frames.empty());
+
+  int frame_num = frame_tree.size();
+  game_controller.prepareNextFrontier();
+  CHECK(frame_tree.size() > frame_num);
+  CHECK(frame_tree.getRootFrameId() == root_frame_id);   // the current frame is still the root
+
+  for(int step = 0; step < micro_frame_num - 1; step++) game_controller.nextStep();
+  game_controller.removeFirstFrame();
+  game_controller.reclaimDiscardedFrames();
+  CHECK(frame_tree.getRootFrameId() == next_root_frame_id && !game_controller.isNextFrontierPrepared());
+  for(auto [frame_id, frame] : kept_frames) {
+    CHECK(&frame_tree.getFrame(frame_id) == frame);
+  }
+}
+
+
+// Each node of the frame tree holds the game state that its frame shows.
+void testFrameTreeHoldsGameStates() {
+  const int micro_frame_num = 5;
+
+  seedTestRand(6);
+  GameController game_controller(micro_frame_num);
+  game_controller.growInitFrameTree();
+
+  auto& frame_tree = game_controller.getFrameTree();
+  int frame_num = 0;
+  forEachFrameTreeEdge(frame_tree, [&](int frame1_id, int frame2_id) {
+    auto& game_state = frame_tree.getGameState(frame2_id);
+    CHECK(game_state.getId() == frame2_id);
+    CHECK(frame_tree.isDecisionFrame(frame1_id) == frame_tree.getGameState(frame1_id).isDecisionGameState());
+    auto frame = game_state.makeFrame();
+    CHECK(frame.size() == frame_tree.getFrame(frame2_id).size());
+    for(int pixel_id = 0; pixel_id < frame.size(); pixel_id++) {
+      CHECK(frame.getPixel(pixel_id) == frame_tree.getFrame(frame2_id).getPixel(pixel_id));
+      CHECK(frame.getPixelIdentity(pixel_id) == frame_tree.getFrame(frame2_id).getPixelIdentity(pixel_id));
+    }
+    frame_num++;
+  });
+  CHECK(frame_num + 1 == frame_tree.size());
+}
+
+
+int main() {
+  RUN_TEST(testColumns);
+  RUN_TEST(testPixelIdentities);
+  RUN_TEST(testEmptyFrame);
+  RUN_TEST(testCopySharesPixels);
+  RUN_TEST(testConcurrentCopies);
+  RUN_TEST(testNextFrontierGrowsInPlace);
+  RUN_TEST(testFrameTreeHoldsGameStates);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <type_traits>
+
+#include "test_util.h"
+
+
+Bullet makeBullet(int id, double z = 0.0) {
+  Bullet bullet;
+  bullet.id = id;
+  bullet.pos = Pos3D(0.0, 0.0, z);
+  return bullet;
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Bullet Ring
+// -------------------------------------------------------------------------------------------
+
+void testBulletRingAdvance() {
+  static_assert(std::is_trivially_copyable_v<BulletRing>);   // so copying a game state does not allocate
+
+  BulletRing bullets;
+  CHECK(bullets.empty());
+
+  bullets.push_back(makeBullet(1, BULLET_MAX_DISTANCE - BULLET_JUMP_DISTANCE));   // the oldest bullet is the highest
+  bullets.push_back(makeBullet(2, BULLET_MAX_DISTANCE - 2.0 * BULLET_JUMP_DISTANCE));
+  bullets.push_back(makeBullet(3));
+  CHECK(bullets.size() == 3 && bullets[0].id == 1);
+
+  bullets.advance();   // bullet 1 reaches the maximum distance
+  CHECK(bullets.size() == 3);
+  CHECK_NEAR(bullets[0].pos.z, BULLET_MAX_DISTANCE, EPSILON);
+  CHECK_NEAR(bullets[2].pos.z, BULLET_JUMP_DISTANCE, EPSILON);
+
+  bullets.advance();   // and goes out of range
+  CHECK(bullets.size() == 2 && bullets[0].id == 2 && bullets[1].id == 3);
+
+  bullets.advance();
+  CHECK(bullets.size() == 1 && bullets[0].id == 3);
+}
+
+
+// One bullet per step, as if the gun fired in every transition, never overflows the ring, and the
+// bullets stay in the order in which they were fired.
+void testBulletRingWrapsAround() {
+  const double fire_z = 125.0;   // the height of a new bullet in GameState::makeGunStateTable()
+  const int max_alive_num = static_cast<int>((BULLET_MAX_DISTANCE - fire_z) / BULLET_JUMP_DISTANCE) + 1;
+  CHECK(max_alive_num <= MAX_BULLET_NUM);
+
+  BulletRing bullets;
+  int max_bullet_num = 0;
+  for(int step = 0; step < 5 * MAX_BULLET_NUM; step++) {   // the ring wraps around several times
+    bullets.advance();
+    bullets.push_back(makeBullet(step, fire_z));
+    max_bullet_num = std::max(max_bullet_num, bullets.size());
+
+    for(int i = 0; i < bullets.size(); i++) {
+      CHECK(bullets[i].id == step - bullets.size() + 1 + i);
+      CHECK_NEAR(bullets[i].pos.z, fire_z + (bullets.size() - 1 - i) * BULLET_JUMP_DISTANCE, EPSILON);
+      CHECK(bullets[i].pos.z <= BULLET_MAX_DISTANCE);
+    }
+  }
+  CHECK(max_bullet_num == max_alive_num);
+}
+
+
+int main() {
+  RUN_TEST(testBulletRingAdvance);
+  RUN_TEST(testBulletRingWrapsAround);
+  return 0;
+}
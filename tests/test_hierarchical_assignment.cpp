@@ -0,0 +1,140 @@
+#include <limits>
+
+#include "test_util.h"
+
+
+// the minimum total cost of assigning each row to a distinct column by the Hungarian algorithm, in O(n^2 m) time
+// for n rows and m >= n columns
+double findMinAssignmentCost(const std::vector<std::vector<double>>& cost) {
+  int n = cost.size();
+  int m = cost[0].size();
+  assert(n <= m);
+  const double INF = std::numeric_limits<double>::max();
+  std::vector<double> u(n + 1, 0.0), v(m + 1, 0.0);
+  std::vector<int> p(m + 1, 0), way(m + 1, 0);   // p[j]: the row matched with column j, 1-based
+  for(int i = 1; i <= n; i++) {
+    p[0] = i;
+    int j0 = 0;
+    std::vector<double> min_v(m + 1, INF);
+    std::vector<bool> used(m + 1, false);
+    do {
+      used[j0] = true;
+      int i0 = p[j0], j1 = 0;
+      double delta = INF;
+      for(int j = 1; j <= m; j++) {
+        if (used[j]) continue;
+        double c = cost[i0 - 1][j - 1] - u[i0] - v[j];
+        if (c < min_v[j]) { min_v[j] = c; way[j] = j0; }
+        if (min_v[j] < delta) { delta = min_v[j]; j1 = j; }
+      }
+      for(int j = 0; j <= m; j++) {
+        if (used[j]) { u[p[j]] += delta; v[j] -= delta; } else { min_v[j] -= delta; }
+      }
+      j0 = j1;
+    } while(p[j0] != 0);
+    do {
+      int j1 = way[j0];
+      p[j0] = p[j1];
+      j0 = j1;
+    } while(j0 != 0);
+  }
+  double total_cost = 0.0;
+  for(int j = 1; j <= m; j++) {
+    if (p[j] != 0) total_cost += cost[p[j] - 1][j - 1];
+  }
+  return total_cost;
+}
+
+
+// the total cost of the flat assignment in SpicompPlanner::computeFormationPlan(), which picks a random drone for
+// each pixel with a probability inversely proportional to the distance
+double findFlatAssignmentCost(const std::vector<std::vector<double>>& cost, const DynamicBitset& candidate_drone_ids) {
+  double total_cost = 0.0;
+  auto unassigned_drone_ids = candidate_drone_ids;
+  for(auto& row : cost) {
+    std::vector<int> drone_ids;
+    std::vector<double> weights;
+    unassigned_drone_ids.forEachSetBit([&](int drone_id) {
+      drone_ids.push_back(drone_id);
+      weights.push_back(1.0 / (row[drone_id] + EPSILON));
+    });
+    int drone_id = drone_ids[SharedRand::getRandWeightedIndex(weights)];
+    total_cost += row[drone_id];
+    unassigned_drone_ids.reset(drone_id);
+  }
+  return total_cost;
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Hierarchical Assignment
+// -------------------------------------------------------------------------------------------
+
+// The hierarchical assignment still picks a random drone within each matched group of cells, so it is not exact. On
+// uniformly scattered pixels and drones it costs about 3 times the optimum (the flat assignment about 11 times).
+#define MAX_HIERARCHICAL_TO_EXACT_COST_RATIO  4.0
+
+void testHierarchicalAssignmentCost() {
+  const int pixel_num = 200;
+  const int drone_num = HIERARCHICAL_ASSIGNMENT_MIN_DRONE_NUM + 100;
+  const int preassigned_pixel_num = 20;
+  std::uniform_real_distribution<> rand_xy(-250.0, 250.0);
+  std::uniform_real_distribution<> rand_z(0.0, 500.0);
+
+  for(int seed = 1; seed <= 3; seed++) {
+    seedTestRand(seed);
+    auto& rng = SharedRand::getRng();
+    FrameBuilder builder;
+    for(int pixel_id = 0; pixel_id < pixel_num; pixel_id++) {
+      builder.addPixel(rand_xy(rng), rand_xy(rng), rand_z(rng), COLOR_RED);
+    }
+    Frame frame2 = builder.build();
+    Formation formation1;
+    for(int drone_id = 0; drone_id < drone_num; drone_id++) {
+      formation1.addDroneState(rand_xy(rng), rand_xy(rng), rand_z(rng));
+    }
+    std::vector<std::int16_t> hidden_since_depths(drone_num, 0);
+
+    // like the persistent pixels, the first pixels are assigned already; the last 100 drones are unavailable
+    DroneAssignment assignment2(pixel_num, drone_num);
+    for(int pixel_id = 0; pixel_id < preassigned_pixel_num; pixel_id++) {
+      assignment2.assign(pixel_id, pixel_id);
+    }
+    auto candidate_drone_ids = assignment2.getUnassignedDroneIds();
+    for(int drone_id = HIERARCHICAL_ASSIGNMENT_MIN_DRONE_NUM; drone_id < drone_num; drone_id++) {
+      candidate_drone_ids.reset(drone_id);
+    }
+    CHECK(candidate_drone_ids.count() >= HIERARCHICAL_ASSIGNMENT_MIN_DRONE_NUM - preassigned_pixel_num);
+
+    SpicompPlanner::assignHoppingPixelsHierarchically(assignment2, frame2, formation1, candidate_drone_ids, hidden_since_depths, 0);
+    CHECK(assignment2.isComplete());
+    for(int pixel_id = 0; pixel_id < pixel_num; pixel_id++) {
+      if (pixel_id < preassigned_pixel_num) {
+        CHECK(assignment2[pixel_id] == pixel_id);
+      } else {
+        CHECK(candidate_drone_ids.test(assignment2[pixel_id]));
+      }
+    }
+
+    // compare the cost of the hopping pixels with the exact assignment over the same candidate drones
+    double cost = 0.0;
+    std::vector<std::vector<double>> costs;
+    for(int pixel_id = preassigned_pixel_num; pixel_id < pixel_num; pixel_id++) {
+      cost += frame2.getPos(pixel_id).distance(formation1.getDroneState(assignment2[pixel_id]).getPos());
+      auto& row = costs.emplace_back(drone_num, std::numeric_limits<double>::max() / (2.0 * pixel_num));
+      candidate_drone_ids.forEachSetBit([&](int drone_id) {
+        row[drone_id] = frame2.getPos(pixel_id).distance(formation1.getDroneState(drone_id).getPos());
+      });
+    }
+    double min_cost = findMinAssignmentCost(costs);
+    CHECK(min_cost <= cost);
+    CHECK(cost <= MAX_HIERARCHICAL_TO_EXACT_COST_RATIO * min_cost);
+    CHECK(cost <= findFlatAssignmentCost(costs, candidate_drone_ids));
+  }
+}
+
+
+int main() {
+  RUN_TEST(testHierarchicalAssignmentCost);
+  return 0;
+}
@@ -0,0 +1,280 @@
+#include "test_util.h"
+
+
+// -------------------------------------------------------------------------------------------
+//   Pixel Correspondence
+// -------------------------------------------------------------------------------------------
+
+// Without pixel identities, a pixel that moves by less than PIXEL_CORRESPONDENCE_MAX_DISTANCE and keeps its color
+// keeps its drone, which flies to it while lit.
+void testCorrespondenceWithoutIdentities() {
+  const int drone_num = 40;
+  const int micro_frame_num = 5;
+  const int pixel_num = 10;
+
+  seedTestRand(3);
+  FrameBuilder builder1, builder2;
+  for(int i = 0; i < pixel_num; i++) {
+    builder1.addPixel(-200.0 + 40.0 * i, 0.0, 100.0, COLOR_RED);
+  }
+  for(int i = 0; i < pixel_num - 2; i++) {
+    builder2.addPixel(-200.0 + 40.0 * i + 15.0, 10.0, 100.0, COLOR_RED);   // the same pixels, moved by about 18
+  }
+  builder2.addPixel(-200.0 + 40.0 * (pixel_num - 2), 0.0, 100.0, COLOR_GREEN);   // same position, another color
+  builder2.addPixel(-200.0 + 40.0 * (pixel_num - 1), 150.0, 100.0, COLOR_RED);   // moved too far
+  Frame frame1 = builder1.build(0);
+  Frame frame2 = builder2.build(1);
+  CHECK(!frame1.hasPixelIdentities() && !frame2.hasPixelIdentities());
+
+  FrameTree frame_tree;
+  frame_tree.addFrame(frame1);
+  frame_tree.setRootFrameId(frame1.getId());
+  frame_tree.addFrame(frame2);
+  frame_tree.addUniqueChildId(frame1.getId(), frame2.getId());
+
+  Formation init_formation;
+  DroneAssignment init_assignment(pixel_num, drone_num);
+  for(int pixel_id = 0; pixel_id < pixel_num; pixel_id++) {
+    init_formation.addDroneState(frame1.getPixel(pixel_id));
+    init_assignment.assign(pixel_id, pixel_id);
+  }
+  for(int drone_id = pixel_num; drone_id < drone_num; drone_id++) {
+    init_formation.addDroneState(-200.0 + 10.0 * drone_id, 200.0, 0.0, COLOR_HIDDEN);
+  }
+  DynamicBitset drone_availability(drone_num, true);
+  ContingencyFormationPlan previous_cf_plan;
+  FormationPlanCache cache;
+  SpicompPlanner planner(drone_num, micro_frame_num, frame_tree, init_formation, init_assignment, previous_cf_plan, cache, drone_availability, 0);
+
+  auto& fplan = planner.getContingencyFormationPlan().getFormationPlan(frame1.getId(), frame2.getId());
+  auto& assignment2 = fplan.getAssignment2();
+  for(int pixel_id = 0; pixel_id < pixel_num - 2; pixel_id++) {
+    CHECK(assignment2[pixel_id] == init_assignment[pixel_id]);
+    auto& drone_state = fplan.getMicroFormation(micro_frame_num / 2).getDroneState(assignment2[pixel_id]);
+    CHECK(!drone_state.getIsHidden() && drone_state.getColor() == COLOR_RED);
+  }
+  for(int pixel_id = pixel_num - 2; pixel_id < pixel_num; pixel_id++) {
+    CHECK(fplan.getMicroFormation(micro_frame_num / 2).getDroneState(assignment2[pixel_id]).getIsHidden());   // a hopping pixel
+  }
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Linear Micro Formations
+// -------------------------------------------------------------------------------------------
+
+template<int MICRO_FRAME_NUM>
+void checkMicroFrameWeights() {
+  constexpr auto& weights = MICRO_FRAME_WEIGHTS<MICRO_FRAME_NUM>;
+  static_assert(weights.size() == MICRO_FRAME_NUM && weights[MICRO_FRAME_NUM - 1] == 1.0);
+  for(int i = 0; i < MICRO_FRAME_NUM; i++) {
+    CHECK(weights[i] == static_cast<double>(i + 1) / static_cast<double>(MICRO_FRAME_NUM));   // bit-identical to the runtime loop
+  }
+}
+
+
+void testMicroFrameWeights() {
+  checkMicroFrameWeights<4>();
+  checkMicroFrameWeights<5>();
+  checkMicroFrameWeights<8>();
+  checkMicroFrameWeights<10>();
+}
+
+
+// The drones on the corresponding pixels fly linearly, whether micro_frame_num is dispatched to an
+// unrolled version (4, 5, 8, 10) or not (3, 6).
+void testLinearMicroFormations() {
+  const int drone_num = 20;
+  const int pixel_num = 8;
+
+  for(int micro_frame_num : { 3, 4, 5, 6, 8, 10 }) {
+    seedTestRand(49);
+    FrameBuilder builder1, builder2;
+    for(int i = 0; i < pixel_num; i++) {
+      builder1.addPixel(-200.0 + 50.0 * i, 0.0, 100.0, COLOR_RED);
+      builder2.addPixel(-200.0 + 50.0 * i + 15.0, 10.0, 90.0 + i, COLOR_RED);
+    }
+    Frame frame1 = builder1.build(0);
+    Frame frame2 = builder2.build(1);
+    FrameTree frame_tree;
+    frame_tree.addFrame(frame1);
+    frame_tree.setRootFrameId(frame1.getId());
+    frame_tree.addFrame(frame2);
+    frame_tree.addUniqueChildId(frame1.getId(), frame2.getId());
+
+    auto [init_formation, init_assignment] = makeInitFormation(frame1, drone_num);
+    DynamicBitset drone_availability(drone_num, true);
+    ContingencyFormationPlan previous_cf_plan;
+    FormationPlanCache cache;
+    SpicompPlanner planner(drone_num, micro_frame_num, frame_tree, init_formation, init_assignment, previous_cf_plan, cache, drone_availability, 0);
+
+    auto& fplan = planner.getContingencyFormationPlan().getFormationPlan(frame1.getId(), frame2.getId());
+    for(int pixel_id = 0; pixel_id < pixel_num; pixel_id++) {
+      int drone_id = fplan.getAssignment2()[pixel_id];
+      CHECK(drone_id == init_assignment[pixel_id]);
+      auto pos1 = frame1.getPos(pixel_id);
+      auto pos2 = frame2.getPos(pixel_id);
+      for(int micro_frame_id = 0; micro_frame_id < micro_frame_num; micro_frame_id++) {
+        double weight = static_cast<double>(micro_frame_id + 1) / static_cast<double>(micro_frame_num);
+        auto expected_pos = (micro_frame_id == micro_frame_num - 1) ? DroneState(pos2.x, pos2.y, pos2.z).getPos() :
+                            DroneState(pos1.x + (pos2.x - pos1.x) * weight, pos1.y + (pos2.y - pos1.y) * weight,
+                                       pos1.z + (pos2.z - pos1.z) * weight).getPos();
+        CHECK(fplan.getMicroFormation(micro_frame_id).getDroneState(drone_id).getPos() == expected_pos);
+      }
+    }
+  }
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Staging
+// -------------------------------------------------------------------------------------------
+
+// A new pixel appears at new_pos in frame2 of the chain frame0 -> frame1 -> frame2 -> frame3, and
+// another one at served_pos, where an idle drone waits already. The gun pixel persists.
+void testStagingTargets() {
+  const int micro_frame_num = 5;
+  const Pos3D gun_pos(0.0, 0.0, 0.0);
+  const Pos3D new_pos(112.5, 112.5, 112.5);
+  const Pos3D served_pos(-112.5, 112.5, 112.5);
+
+  FrameTree frame_tree;
+  for(int frame_id = 0; frame_id < 4; frame_id++) {
+    FrameBuilder builder;
+    builder.addPixel(Pixel(gun_pos, COLOR_GREEN), 0);
+    if (frame_id >= 2) {
+      builder.addPixel(Pixel(new_pos, COLOR_ORANGE_RED), 1);
+      builder.addPixel(Pixel(served_pos, COLOR_ORANGE_RED), 2);
+    }
+    frame_tree.addFrame(builder.build(frame_id));
+    if (frame_id > 0) frame_tree.addUniqueChildId(frame_id - 1, frame_id);
+  }
+  frame_tree.setRootFrameId(0);
+
+  const int drone_num = 5;
+  Formation init_formation;
+  init_formation.addDroneState(gun_pos.x, gun_pos.y, gun_pos.z, COLOR_GREEN);
+  init_formation.addDroneState(-200.0, -200.0, 0.0, COLOR_HIDDEN);         // 1: the nearest movable drone to new_pos
+  init_formation.addDroneState(-110.0, 115.0, 110.0, COLOR_HIDDEN);        // 2: in the cell of served_pos
+  init_formation.addDroneState(240.0, -240.0, 450.0, COLOR_HIDDEN);        // 3: farther away
+  init_formation.addDroneState(new_pos.x, new_pos.y, 400.0, COLOR_HIDDEN); // 4: unavailable
+  DroneAssignment init_assignment(1, drone_num);
+  init_assignment.assign(0, 0);
+  DynamicBitset drone_availability(drone_num, true);
+  drone_availability.reset(4);
+
+  for(bool is_staging_enabled : { true, false }) {
+    seedTestRand(50);
+    ContingencyFormationPlan previous_cf_plan;
+    FormationPlanCache cache;
+    SpicompPlanner planner(drone_num, micro_frame_num, frame_tree, init_formation, init_assignment, previous_cf_plan, cache, drone_availability, 0, is_staging_enabled);
+
+    CHECK(planner.hasStagingTarget(1) == is_staging_enabled);
+    if (is_staging_enabled) CHECK(planner.getStagingTarget(1).distance(new_pos) < EPSILON);
+    CHECK(!planner.hasStagingTarget(0));   // lit
+    CHECK(!planner.hasStagingTarget(2));   // its hop is short already
+    CHECK(!planner.hasStagingTarget(3));   // the only new pixel without an idle drone is claimed by drone 1
+    CHECK(!planner.hasStagingTarget(4));
+  }
+}
+
+
+// A cell claims the nearest movable drone among many.
+void testStagingClaimsNearestDrone() {
+  const int micro_frame_num = 5;
+  const int drone_num = 300;
+  const Pos3D new_pos(12.5, 12.5, 112.5);
+
+  FrameTree frame_tree;
+  for(int frame_id = 0; frame_id < 2; frame_id++) {
+    FrameBuilder builder;
+    builder.addPixel(Pixel(0.0, 0.0, 0.0, COLOR_GREEN), 0);
+    if (frame_id == 1) builder.addPixel(Pixel(new_pos, COLOR_ORANGE_RED), 1);
+    frame_tree.addFrame(builder.build(frame_id));
+  }
+  frame_tree.setRootFrameId(0);
+  frame_tree.addUniqueChildId(0, 1);
+
+  seedTestRand(51);
+  auto& rng = SharedRand::getRng();
+  std::uniform_real_distribution<double> coord_dist(-250.0, 250.0);
+  Formation init_formation;
+  init_formation.addDroneState(0.0, 0.0, 0.0, COLOR_GREEN);
+  int nearest_drone_id = -1;
+  for(int drone_id = 1; drone_id < drone_num; drone_id++) {
+    Pos3D pos(coord_dist(rng), coord_dist(rng), 250.0 + coord_dist(rng));
+    if (getGridCellKey(pos.x, pos.y, pos.z, STAGING_CELL_SIZE) == getGridCellKey(new_pos.x, new_pos.y, new_pos.z, STAGING_CELL_SIZE)) pos.z += 100.0;
+    init_formation.addDroneState(pos.x, pos.y, pos.z, COLOR_HIDDEN);
+    if (nearest_drone_id < 0 || pos.distance(new_pos) < init_formation.getDroneState(nearest_drone_id).getPos().distance(new_pos)) nearest_drone_id = drone_id;
+  }
+  DroneAssignment init_assignment(1, drone_num);
+  init_assignment.assign(0, 0);
+  DynamicBitset drone_availability(drone_num, true);
+
+  ContingencyFormationPlan previous_cf_plan;
+  FormationPlanCache cache;
+  SpicompPlanner planner(drone_num, micro_frame_num, frame_tree, init_formation, init_assignment, previous_cf_plan, cache, drone_availability, 0);
+  for(int drone_id = 0; drone_id < drone_num; drone_id++) {
+    CHECK(planner.hasStagingTarget(drone_id) == (drone_id == nearest_drone_id));
+  }
+}
+
+
+// The new pixels of a frame are counted once across replans, and the staging targets are the same
+// as without the cache.
+void testStagingDemandCache() {
+  const int drone_num = 100;
+  const int micro_frame_num = 5;
+
+  seedTestRand(52);
+  GameController game_controller(micro_frame_num);
+  game_controller.growInitFrameTree();
+  FrameTree frame_tree = game_controller.getFrameTree();
+  auto [init_formation, init_assignment] = makeInitFormation(frame_tree.getRootFrame(), drone_num);
+  DynamicBitset drone_availability(drone_num, true);
+  ContingencyFormationPlan previous_cf_plan;
+  FormationPlanCache cache(0);
+  StagingDemandCache staging_demand_cache;
+
+  auto checkSameStagingTargets = [&](int root_frame_id) {
+    SpicompPlanner cached_planner(drone_num, micro_frame_num, frame_tree, root_frame_id, init_formation, init_assignment, previous_cf_plan, cache, drone_availability,
+                                  game_controller.getPixelTrajectoryTrackingNum(), true, &staging_demand_cache);
+    SpicompPlanner fresh_planner(drone_num, micro_frame_num, frame_tree, root_frame_id, init_formation, init_assignment, previous_cf_plan, cache, drone_availability,
+                                 game_controller.getPixelTrajectoryTrackingNum(), true);
+    int staging_target_num = 0;
+    for(int drone_id = 0; drone_id < drone_num; drone_id++) {
+      CHECK(cached_planner.hasStagingTarget(drone_id) == fresh_planner.hasStagingTarget(drone_id));
+      if (!cached_planner.hasStagingTarget(drone_id)) continue;
+      CHECK(cached_planner.getStagingTarget(drone_id).distance(fresh_planner.getStagingTarget(drone_id)) < EPSILON);
+      staging_target_num++;
+    }
+    return staging_target_num;
+  };
+
+  CHECK(checkSameStagingTargets(frame_tree.getRootFrameId()) > 0);
+  int frame_num = 0;
+  forEachFrameTreeEdge(frame_tree, [&](int, int) { frame_num++; });
+  CHECK(staging_demand_cache.size() == frame_num);   // every frame below the root
+
+  int next_root_frame_id = frame_tree.getNextRootFrameId();
+  checkSameStagingTargets(next_root_frame_id);
+  CHECK(staging_demand_cache.size() == frame_num);   // nothing new to count
+
+  frame_tree.pop_front();
+  frame_tree.reclaimDiscardedFrames();
+  staging_demand_cache.collectGarbage(frame_tree);
+  int live_frame_num = 0;
+  forEachFrameTreeEdge(frame_tree, [&](int, int) { live_frame_num++; });
+  CHECK(staging_demand_cache.size() == live_frame_num + 1);   // and the new root frame
+}
+
+
+int main() {
+  RUN_TEST(testCorrespondenceWithoutIdentities);
+  RUN_TEST(testMicroFrameWeights);
+  RUN_TEST(testLinearMicroFormations);
+  RUN_TEST(testStagingTargets);
+  RUN_TEST(testStagingClaimsNearestDrone);
+  RUN_TEST(testStagingDemandCache);
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include "test_util.h"
+
+
+using TestQuantizedPrecision = QuantizedPrecision<QUANTIZED_GEOMETRY_STEP_MILLI>;
+using QuantizedDroneState = BasicDroneState<TestQuantizedPrecision>;
+
+
+// -------------------------------------------------------------------------------------------
+//   Encoding
+// -------------------------------------------------------------------------------------------
+
+template<typename Precision>
+void checkEncodingError(double max_abs_value) {
+  const double max_error = Precision::getMaxEncodingError(max_abs_value);
+  for(int i = -1000; i <= 1000; i++) {
+    double v = max_abs_value * i / 1000.0 + 0.0001 * (i % 7);   // off the grid of the steps
+    v = std::clamp(v, -max_abs_value, max_abs_value);
+    CHECK(std::abs(Precision::decode(Precision::encode(v)) - v) <= max_error);
+  }
+}
+
+
+void testEncodingError() {
+  checkEncodingError<DoublePrecision>(MAX_WORLD_COORD);
+  checkEncodingError<FloatPrecision>(MAX_WORLD_COORD);
+  checkEncodingError<TestQuantizedPrecision>(MAX_WORLD_COORD);
+  checkEncodingError<TestQuantizedPrecision>(TestQuantizedPrecision::MAX_ABS_VALUE);
+}
+
+
+void testQuantizedRange() {
+  CHECK_NEAR(TestQuantizedPrecision::STEP, QUANTIZED_GEOMETRY_STEP_MILLI / 1000.0, 1e-12);
+  CHECK_NEAR(QuantizedPrecision<25>::MAX_ABS_VALUE, 819.175, 1e-9);
+  CHECK(MAX_WORLD_COORD <= TestQuantizedPrecision::MAX_ABS_VALUE);
+
+  // beyond the range, a coordinate is clamped silently
+  CHECK_NEAR(TestQuantizedPrecision::decode(TestQuantizedPrecision::encode(2.0 * TestQuantizedPrecision::MAX_ABS_VALUE)), TestQuantizedPrecision::MAX_ABS_VALUE, 1e-9);
+  CHECK(TestQuantizedPrecision::decode(TestQuantizedPrecision::encode(-2.0 * TestQuantizedPrecision::MAX_ABS_VALUE)) < -TestQuantizedPrecision::MAX_ABS_VALUE);
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Speed Limit
+// -------------------------------------------------------------------------------------------
+
+// A flight that steps by the speed limit less the error of both stored ends, as the planner does,
+// keeps every step between the stored positions within the limit.
+void testQuantizedFlightKeepsSpeedLimit() {
+  const double limit = MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME / 5.0;   // with 5 micro frames per frame
+  const double max_step_distance = limit - 2.0 * TestQuantizedPrecision::getMaxEncodingError(MAX_WORLD_COORD);
+
+  seedTestRand(48);
+  auto& rng = SharedRand::getRng();
+  std::uniform_real_distribution<double> coord_dist(-250.0, 250.0);
+  for(int flight = 0; flight < 1000; flight++) {
+    auto pos = QuantizedDroneState(coord_dist(rng), coord_dist(rng), coord_dist(rng)).getPos();
+    const auto target = QuantizedDroneState(coord_dist(rng), coord_dist(rng), coord_dist(rng)).getPos();
+    for(int step = 0; !(pos == target); step++) {
+      CHECK(step < 10);
+      auto next_pos = target;
+      double dist = pos.distance(target);
+      if (dist > limit) {
+        next_pos = QuantizedDroneState(pos.x + (target.x - pos.x) * max_step_distance / dist,
+                                       pos.y + (target.y - pos.y) * max_step_distance / dist,
+                                       pos.z + (target.z - pos.z) * max_step_distance / dist).getPos();
+      }
+      CHECK(pos.distance(next_pos) <= limit);
+      pos = next_pos;
+    }
+  }
+}
+
+
+int main() {
+  RUN_TEST(testEncodingError);
+  RUN_TEST(testQuantizedRange);
+  RUN_TEST(testQuantizedFlightKeepsSpeedLimit);
+  return 0;
+}
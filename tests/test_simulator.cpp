@@ -0,0 +1,166 @@
+#include "test_util.h"
+
+
+const double MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME = MAX_DRONE_FLIGHT_DISTANCE_PER_FRAME / 5.0;   // the simulator uses 5 micro frames
+
+
+// Run the simulator for step_num steps and check that no drone flies faster than the speed limit,
+// that the failed drones do not move at all, and that every drone assigned to a pixel of the next
+// frame is lit there.
+void runAndCheckFlights(SpicompSimulator& simulator, Formation previous_formation, const std::vector<std::pair<int, Pos3D>>& failed_drones, int step_num) {
+  for(int step = 0; step < step_num; step++) {
+    auto& fplan = simulator.getCurrentFormationPlan();
+    for(auto drone_id : fplan.getAssignment2()) {
+      if (drone_id >= 0) CHECK(!fplan.getFormation2().getDroneState(drone_id).getIsHidden());
+    }
+
+    auto& formation = simulator.getCurrentMicroFormation();
+    for(int drone_id = 0; drone_id < formation.size(); drone_id++) {
+      auto distance = previous_formation.getDroneState(drone_id).getPos().distance(formation.getDroneState(drone_id).getPos());
+      CHECK(distance <= MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME + 1e-6);
+    }
+    for(auto& [drone_id, pos] : failed_drones) {
+      CHECK(formation.getDroneState(drone_id).getPos() == pos);
+      CHECK(formation.getDroneState(drone_id).getIsHidden());
+    }
+    previous_formation = formation;
+    simulator.nextStep();
+  }
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Drone Failures
+// -------------------------------------------------------------------------------------------
+
+// The micro frame before micro_frame_step_count has been shown when a drone fails, and the failed
+// drone stays where it is in that micro frame.
+
+// A lit drone that fails in the last micro frame of a frame leaves a single micro frame for its
+// replacement, which must not fly faster than the speed limit to get there.
+void testDisableLitDrone() {
+  auto setting = makeTestSetting();
+  for(auto [seed, frame_num] : { std::pair{1, 2}, std::pair{2, 2}, std::pair{3, 4}, std::pair{4, 6} }) {
+    seedTestRand(seed);
+    SpicompSimulator simulator(setting);
+    simulator.reset();
+    for(int step = 0; step < 5 * frame_num + 3; step++) simulator.nextStep();
+
+    Formation previous_formation = simulator.getCurrentMicroFormation();
+    simulator.nextStep();   // the last micro frame of a frame
+
+    int failed_drone_id = 0;   // a gun pixel, which is lit in every frame
+    CHECK(!previous_formation.getDroneState(failed_drone_id).getIsHidden());
+    CHECK(simulator.disableDrone(failed_drone_id));
+    CHECK(!simulator.isDroneAvailable(failed_drone_id));
+
+    auto failed_drone_pos = previous_formation.getDroneState(failed_drone_id).getPos();
+    runAndCheckFlights(simulator, previous_formation, { { failed_drone_id, failed_drone_pos } }, 50);
+  }
+}
+
+
+// A replacement that is too far to reach the pixel of a failed drone in time is slowed down to the
+// speed limit. The pixel stays uncovered until the replacement arrives, and is covered again by the
+// next plans.
+void testSlowReplacementCoversPixelLater() {
+  auto setting = makeTestSetting();
+  for(auto seed : { 1, 2, 3 }) {
+    seedTestRand(seed);
+    SpicompSimulator simulator(setting);
+    simulator.reset();
+    for(int step = 0; step < 5 * 2 + 3; step++) simulator.nextStep();
+
+    Formation previous_formation = simulator.getCurrentMicroFormation();
+    simulator.nextStep();   // the last micro frame of a frame
+
+    // no hidden drone is left within a micro frame of the gun pixel in the next frame
+    int failed_drone_id = 0;
+    auto failed_drone_pos = previous_formation.getDroneState(failed_drone_id).getPos();
+    auto pixel_pos = simulator.getCurrentFormationPlan().getFormation2().getDroneState(failed_drone_id).getPos();
+    std::vector<std::pair<int, Pos3D>> failed_drones = { { failed_drone_id, failed_drone_pos } };
+    for(int drone_id = 0; drone_id < previous_formation.size(); drone_id++) {
+      auto& drone_state = previous_formation.getDroneState(drone_id);
+      if (drone_state.getIsHidden() && drone_state.getPos().distance(pixel_pos) <= MAX_DRONE_FLIGHT_DISTANCE_PER_MICROFRAME) {
+        CHECK(simulator.disableDrone(drone_id));
+        failed_drones.emplace_back(drone_id, drone_state.getPos());
+      }
+    }
+    CHECK(simulator.disableDrone(failed_drone_id));
+    CHECK(!simulator.getCurrentFormationPlan().getAssignment2().isComplete());   // the replacement is too far
+
+    runAndCheckFlights(simulator, previous_formation, failed_drones, 1);
+    for(int frame = 0; frame < 6 && !simulator.getCurrentFormationPlan().getAssignment2().isComplete(); frame++) {
+      previous_formation = simulator.getCurrentMicroFormation();
+      runAndCheckFlights(simulator, previous_formation, failed_drones, 5);
+    }
+    CHECK(simulator.getCurrentFormationPlan().getAssignment2().isComplete());
+
+    previous_formation = simulator.getCurrentMicroFormation();
+    runAndCheckFlights(simulator, previous_formation, failed_drones, 50);
+  }
+}
+
+
+// A hidden drone that is on its way to a pixel in a later frame must stop as well.
+void testDisableFlyingHiddenDrone() {
+  auto setting = makeTestSetting();
+  for(auto seed : { 1, 2, 3 }) {
+    seedTestRand(seed);
+    SpicompSimulator simulator(setting);
+    simulator.reset();
+
+    // fail a hidden drone as soon as it is seen moving fast
+    int failed_drone_id = -1;
+    Formation previous_formation;
+    for(int step = 0; step < 200 && failed_drone_id < 0; step++) {
+      previous_formation = simulator.getCurrentMicroFormation();
+      simulator.nextStep();
+      auto& formation = simulator.getCurrentMicroFormation();
+      for(int drone_id = 0; drone_id < formation.size(); drone_id++) {
+        auto& drone_state = formation.getDroneState(drone_id);
+        if (drone_state.getIsHidden() && drone_state.getPos().distance(previous_formation.getDroneState(drone_id).getPos()) > 50.0) {
+          failed_drone_id = drone_id;
+          break;
+        }
+      }
+    }
+    CHECK(failed_drone_id >= 0);
+    simulator.disableDrone(failed_drone_id);
+
+    auto failed_drone_pos = previous_formation.getDroneState(failed_drone_id).getPos();
+    runAndCheckFlights(simulator, previous_formation, { { failed_drone_id, failed_drone_pos } }, 50);
+  }
+}
+
+
+// -------------------------------------------------------------------------------------------
+//   Staging
+// -------------------------------------------------------------------------------------------
+
+// The idle hidden drones wait where the new pixels will appear, so the hidden drones fly less to
+// their new pixels than when they park where they went dark (see bench/bench_simulator).
+void testStagingShortensHops() {
+  auto setting = makeTestSetting();
+  for(auto seed : { 1, 2 }) {
+    double mean_hops[2];
+    for(bool is_staging_enabled : { true, false }) {
+      seedTestRand(seed);
+      SpicompSimulator simulator(setting);
+      simulator.setStagingEnabled(is_staging_enabled);
+      simulator.reset();
+      for(int step = 0; step < 300; step++) simulator.nextStep();
+      mean_hops[is_staging_enabled] = simulator.getHopStatistics().getMeanDistancePerFrame();
+    }
+    CHECK(mean_hops[true] < 0.8 * mean_hops[false]);
+  }
+}
+
+
+int main() {
+  RUN_TEST(testDisableLitDrone);
+  RUN_TEST(testSlowReplacementCoversPixelLater);
+  RUN_TEST(testDisableFlyingHiddenDrone);
+  RUN_TEST(testStagingShortensHops);
+  return 0;
+}
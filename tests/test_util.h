@@ -0,0 +1,108 @@
+#ifndef SPICOMP_TESTS_TEST_UTIL_H
+#define SPICOMP_TESTS_TEST_UTIL_H
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include "util/rng.h"
+#include "spicomp_setting.h"
+#include "spicomp_simulator.h"
+
+
+/* --------------------------------------------------------------------------------------------------
+ * CHECK - stop the test with an error message if the condition does not hold
+ *
+ * Usage: CHECK(s.count() == 3);  CHECK_NEAR(x, 0.5, 1e-12);  RUN_TEST(testCount);
+ *
+ * Unlike assert(), the checks are not removed by NDEBUG, so the tests work in all build types.
+ * -------------------------------------------------------------------------------------------------- */
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+      std::exit(EXIT_FAILURE); \
+    } \
+  } while(false)
+
+#define CHECK_NEAR(value1, value2, tolerance) \
+  do { \
+    auto v1_ = (value1); \
+    auto v2_ = (value2); \
+    if (!(std::abs(v1_ - v2_) <= (tolerance))) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_NEAR(" #value1 ", " #value2 ", " #tolerance ") failed: " \
+                << v1_ << " vs " << v2_ << std::endl; \
+      std::exit(EXIT_FAILURE); \
+    } \
+  } while(false)
+
+#define RUN_TEST(test_function) \
+  do { \
+    std::cout << #test_function << std::endl; \
+    test_function(); \
+  } while(false)
+
+
+/* --------------------------------------------------------------------------------------------------
+ * The fixtures shared by the tests
+ * -------------------------------------------------------------------------------------------------- */
+
+// the setting of testcase/config_001.yml, without reading the file
+inline SpicompSetting makeTestSetting() {
+  SpicompSetting setting;
+  setting.init(YAML::Load("{RandSeed: 1, IsShowRandSeed: false, WindowSizeX: 1000, WindowSizeY: 1000, "
+                          "SceneSizeX: 500, SceneSizeY: 500, SceneSizeZ: 500}"));
+  return setting;
+}
+
+// SharedRand is initialized once per process; reseeding it makes a test reproducible
+inline void seedTestRand(std::mt19937::result_type seed) {
+  SharedRand::init(seed, false);
+  SharedRand::getRng().seed(seed);
+}
+
+// the drones on the pixels of the root frame first and the hidden drones at random positions,
+// like SpicompSimulator::reset()
+inline std::pair<Formation, DroneAssignment> makeInitFormation(const Frame& root_frame, int drone_num, double scene_size = 500.0) {
+  Formation formation;
+  DroneAssignment assignment(root_frame.size(), drone_num);
+  for(int pixel_id = 0; pixel_id < root_frame.size(); pixel_id++) {
+    formation.addDroneState(root_frame.getPixel(pixel_id));
+    assignment.assign(pixel_id, pixel_id);
+  }
+  std::uniform_real_distribution<> rand_xy(-scene_size / 2.0, scene_size / 2.0);
+  std::uniform_real_distribution<> rand_z(0.0, scene_size);
+  auto& rng = SharedRand::getRng();
+  for(int drone_id = formation.size(); drone_id < drone_num; drone_id++) {
+    formation.addDroneState(rand_xy(rng), rand_xy(rng), rand_z(rng));
+  }
+  return { formation, assignment };
+}
+
+// call f(frame1_id, frame2_id) for every edge of the frame tree
+template<typename F>
+void forEachFrameTreeEdge(const FrameTree& frame_tree, F f) {
+  std::vector<int> stack = { frame_tree.getRootFrameId() };
+  while(!stack.empty()) {
+    int frame_id = stack.back();
+    stack.pop_back();
+    if (frame_tree.isTerminalFrame(frame_id)) continue;
+    for(auto [option, child_frame_id] : frame_tree.getAllChildrenIdsWithOptions(frame_id)) {
+      f(frame_id, child_frame_id);
+      stack.push_back(child_frame_id);
+    }
+  }
+}
+
+inline bool isSameFormation(const Formation& formation1, const Formation& formation2) {
+  if (formation1.size() != formation2.size()) return false;
+  for(int drone_id = 0; drone_id < formation1.size(); drone_id++) {
+    if (!(formation1.getDroneState(drone_id).getPixel() == formation2.getDroneState(drone_id).getPixel())) return false;
+  }
+  return true;
+}
+
+
+#endif //SPICOMP_TESTS_TEST_UTIL_H
@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include "util/bitset.h"
+
+
+int DynamicBitset::count() const {
+  int n = 0;
+  for(auto word : words) {
+    n += std::popcount(word);
+  }
+  return n;
+}
+
+
+bool DynamicBitset::any() const {
+  return std::any_of(words.begin(), words.end(), [](Word word) { return word != 0; });
+}
+
+
+int DynamicBitset::findNext(int i) const {
+  i++;
+  if (i >= bit_num) return -1;
+  std::size_t w = i / WORD_BIT_NUM;
+  Word word = words[w] & (~Word{0} << (i % WORD_BIT_NUM));
+  while(word == 0) {
+    w++;
+    if (w >= words.size()) return -1;
+    word = words[w];
+  }
+  return static_cast<int>(w) * WORD_BIT_NUM + std::countr_zero(word);
+}
+
+
+DynamicBitset& DynamicBitset::operator&=(const DynamicBitset& other) {
+  assert(bit_num == other.bit_num);
+  for(std::size_t w = 0; w < words.size(); w++) {
+    words[w] &= other.words[w];
+  }
+  return *this;
+}
+
+
+DynamicBitset& DynamicBitset::operator|=(const DynamicBitset& other) {
+  assert(bit_num == other.bit_num);
+  for(std::size_t w = 0; w < words.size(); w++) {
+    words[w] |= other.words[w];
+  }
+  return *this;
+}
+
+
+DynamicBitset& DynamicBitset::operator^=(const DynamicBitset& other) {
+  assert(bit_num == other.bit_num);
+  for(std::size_t w = 0; w < words.size(); w++) {
+    words[w] ^= other.words[w];
+  }
+  return *this;
+}
+
+
+DynamicBitset& DynamicBitset::subtract(const DynamicBitset& other) {
+  assert(bit_num == other.bit_num);
+  for(std::size_t w = 0; w < words.size(); w++) {
+    words[w] &= ~other.words[w];
+  }
+  return *this;
+}
+
+
+DynamicBitset DynamicBitset::operator~() const {
+  DynamicBitset result = *this;
+  for(auto& word : result.words) {
+    word = ~word;
+  }
+  result.clearUnusedBits();
+  return result;
+}
+
+
+std::ostream& operator<<(std::ostream& out, const DynamicBitset& s) {
+  for(int i = 0; i < s.size(); i++) {
+    out << (s.test(i) ? '1' : '0');
+  }
+  return out;
+}
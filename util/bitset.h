@@ -0,0 +1,118 @@
+#ifndef UTIL_BITSET_H
+#define UTIL_BITSET_H
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <bit>
+#include <algorithm>
+#include <cassert>
+
+
+/* --------------------------------------------------------------------------------------------------
+ * DynamicBitset - a bitset whose size is determined at run time
+ *
+ * Usage: DynamicBitset s(100);  s.set(3);  s.set(70);
+ *        t &= s;  t.subtract(s);
+ *        for(int i = s.findFirst(); i >= 0; i = s.findNext(i)) { ... }
+ *
+ * The bits are stored in 64-bit words so that set operations and enumeration work on a whole word
+ * at a time. The unused bits of the last word are always zero.
+ * -------------------------------------------------------------------------------------------------- */
+
+class DynamicBitset {
+
+  using Word = std::uint64_t;
+  static constexpr int WORD_BIT_NUM = 64;
+
+  int bit_num;
+  std::vector<Word> words;
+
+  static int getWordNum(int bit_num) { return (bit_num + WORD_BIT_NUM - 1) / WORD_BIT_NUM; }
+  static Word getMask(int i) { return Word{1} << (i % WORD_BIT_NUM); }
+
+  void clearUnusedBits() {
+    if (bit_num % WORD_BIT_NUM != 0) {
+      words.back() &= (Word{1} << (bit_num % WORD_BIT_NUM)) - 1;
+    }
+  }
+
+public:
+
+  DynamicBitset() : bit_num{0} {}
+
+  explicit DynamicBitset(int bit_num, bool value = false) :
+      bit_num{bit_num}, words(getWordNum(bit_num), value ? ~Word{0} : Word{0})
+  {
+    assert(bit_num >= 0);
+    clearUnusedBits();
+  }
+
+  int size() const { return bit_num; }
+  bool empty() const { return bit_num == 0; }
+
+  bool test(int i) const {
+    assert(0 <= i && i < bit_num);
+    return (words[i / WORD_BIT_NUM] & getMask(i)) != 0;
+  }
+
+  bool operator[](int i) const { return test(i); }
+
+  void set(int i) {
+    assert(0 <= i && i < bit_num);
+    words[i / WORD_BIT_NUM] |= getMask(i);
+  }
+
+  void reset(int i) {
+    assert(0 <= i && i < bit_num);
+    words[i / WORD_BIT_NUM] &= ~getMask(i);
+  }
+
+  void set(int i, bool value) { if (value) set(i); else reset(i); }
+
+  void setAll() {
+    std::fill(words.begin(), words.end(), ~Word{0});
+    clearUnusedBits();
+  }
+
+  void resetAll() { std::fill(words.begin(), words.end(), Word{0}); }
+
+  int count() const;
+
+  bool any() const;
+  bool none() const { return !any(); }
+
+  int findFirst() const { return findNext(-1); }   // return -1 if no bit is set
+  int findNext(int i) const;                        // the first set bit after i, or -1 if none
+
+  template<typename F>
+  void forEachSetBit(F f) const {      // call f(i) for each set bit i in increasing order
+    for(std::size_t w = 0; w < words.size(); w++) {
+      Word word = words[w];
+      while(word != 0) {
+        f(static_cast<int>(w) * WORD_BIT_NUM + std::countr_zero(word));
+        word &= word - 1;
+      }
+    }
+  }
+
+  DynamicBitset& operator&=(const DynamicBitset& other);
+  DynamicBitset& operator|=(const DynamicBitset& other);
+  DynamicBitset& operator^=(const DynamicBitset& other);
+  DynamicBitset& subtract(const DynamicBitset& other);    // remove all bits set in other
+
+  DynamicBitset operator~() const;
+
+  friend DynamicBitset operator&(DynamicBitset s1, const DynamicBitset& s2) { return s1 &= s2; }
+  friend DynamicBitset operator|(DynamicBitset s1, const DynamicBitset& s2) { return s1 |= s2; }
+  friend DynamicBitset operator^(DynamicBitset s1, const DynamicBitset& s2) { return s1 ^= s2; }
+  friend DynamicBitset operator-(DynamicBitset s1, const DynamicBitset& s2) { return s1.subtract(s2); }
+
+  bool operator==(const DynamicBitset& other) const { return bit_num == other.bit_num && words == other.words; }
+
+  friend std::ostream& operator<<(std::ostream& out, const DynamicBitset& s);
+
+};
+
+
+#endif //UTIL_BITSET_H
@@ -0,0 +1,54 @@
+#ifndef UTIL_PARALLEL_H
+#define UTIL_PARALLEL_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cassert>
+
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
+
+
+/* --------------------------------------------------------------------------------------------------
+ * parallel_for() - call f(i) for i = 0, 1, ..., n-1 on all hardware threads
+ *
+ * Usage: parallel_for(n, [&](int i) { result[i] = compute(i); });
+ *        parallel_for(n, [&](int i) { result[i] = compute(i); }, 8);   // at least 8 calls per thread
+ *
+ * The calls of f must not depend on each other, and f must not write to shared data other than
+ * its own slot. The indices are handed out dynamically, so uneven workloads are balanced. The calls
+ * run sequentially when n is small or when threads are not available (e.g., in the web build).
+ * -------------------------------------------------------------------------------------------------- */
+
+template<typename F>
+void parallel_for(int n, F f, int min_call_num_per_thread = 1) {
+  assert(n >= 0 && min_call_num_per_thread >= 1);
+#ifndef __EMSCRIPTEN__
+  int thread_num = std::min(n / min_call_num_per_thread, static_cast<int>(std::thread::hardware_concurrency()));
+  if (thread_num > 1) {
+    std::atomic<int> next_i{0};
+    auto worker = [&]() {
+      for(int i = next_i++; i < n; i = next_i++) {
+        f(i);
+      }
+    };
+    std::vector<std::thread> threads;
+    for(int t = 1; t < thread_num; t++) {
+      threads.emplace_back(worker);
+    }
+    worker();    // the calling thread also does its share of the work
+    for(auto& thread : threads) {
+      thread.join();
+    }
+    return;
+  }
+#endif
+  for(int i = 0; i < n; i++) {
+    f(i);
+  }
+}
+
+
+#endif //UTIL_PARALLEL_H
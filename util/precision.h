@@ -0,0 +1,59 @@
+#ifndef UTIL_PRECISION_H
+#define UTIL_PRECISION_H
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+/* --------------------------------------------------------------------------------------------------
+ * DoublePrecision, FloatPrecision, QuantizedPrecision<STEP_MILLI> - how a stored coordinate is encoded
+ *
+ * Usage: using P = QuantizedPrecision<25>;     // steps of 0.025 units
+ *        P::Coord c = P::encode(12.34);  double v = P::decode(c);
+ *        static_assert(800.0 <= P::MAX_ABS_VALUE);
+ *
+ * A precision policy defines the type in which a coordinate is stored and the conversions from
+ * and to double. The computation is always done in double; the policy only decides how much
+ * memory a stored coordinate takes. The coordinates are in the units of the caller (the simulator
+ * units, in which the scene is 500 units wide). QuantizedPrecision stores a coordinate as a 16-bit
+ * multiple of STEP_MILLI / 1000 units, e.g., 0.025 units for 25, which covers +-819.175 units.
+ * A coordinate beyond MAX_ABS_VALUE is clamped silently, so the caller must keep its coordinates
+ * in range. getMaxEncodingError(max_abs_value) bounds |decode(encode(v)) - v| for |v| <= max_abs_value.
+ * -------------------------------------------------------------------------------------------------- */
+
+struct DoublePrecision {
+  using Coord = double;
+  static constexpr double MAX_ABS_VALUE = std::numeric_limits<double>::max();
+  static constexpr double getMaxEncodingError(double) { return 0.0; }
+  static Coord encode(double v) { return v; }
+  static double decode(Coord c) { return c; }
+};
+
+
+struct FloatPrecision {
+  using Coord = float;
+  static constexpr double MAX_ABS_VALUE = std::numeric_limits<float>::max();
+  static constexpr double getMaxEncodingError(double max_abs_value) { return max_abs_value * std::numeric_limits<float>::epsilon(); }
+  static Coord encode(double v) { return static_cast<float>(v); }
+  static double decode(Coord c) { return c; }
+};
+
+
+template<int STEP_MILLI>
+struct QuantizedPrecision {
+  static_assert(STEP_MILLI > 0);
+  using Coord = std::int16_t;
+  static constexpr double STEP = STEP_MILLI / 1000.0;
+  static constexpr double MAX_ABS_VALUE = std::numeric_limits<Coord>::max() * STEP;
+  static constexpr double getMaxEncodingError(double) { return STEP / 2.0; }
+  static Coord encode(double v) {
+    auto q = std::lround(v / STEP);
+    return static_cast<Coord>(std::clamp<long>(q, std::numeric_limits<Coord>::min(), std::numeric_limits<Coord>::max()));
+  }
+  static double decode(Coord c) { return c * STEP; }
+};
+
+
+#endif //UTIL_PRECISION_H
@@ -77,6 +77,20 @@ namespace std
 }
 
 
+/* --------------------------------------------------------------------------------------------------
+ * hash_combine() - mix the hash value of v into seed
+ *
+ * Usage: std::size_t seed = 0; hash_combine(seed, x); hash_combine(seed, y);
+ *
+ * See: https://www.boost.org/doc/libs/1_76_0/doc/html/hash/reference.html#boost.hash_combine
+ * -------------------------------------------------------------------------------------------------- */
+
+template<typename T>
+void hash_combine(std::size_t& seed, const T& v) {
+  seed ^= std::hash<T>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+
 /* --------------------------------------------------------------------------------------------------
  * vector-based counter
  * -------------------------------------------------------------------------------------------------- */